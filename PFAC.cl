@@ -1,10 +1,313 @@
 
+/**
+ * The following constants are passed to the OpenCL program by the Host
+ * (see pfacBuildOptions() in pfac_ocl.cpp).
+ * INVALID
+ * MASKBITS
+ * MASK
+ * WORK_GROUP_SIZE
+ * MAX_PATTERN_SIZE   overlap, in ints, read past the end of a Work Group's input
+ * USE_TEXTURE        defined when the tables are image1d_buffer_t objects
+ *
+ * Devices without image support (or with images too small for the tables)
+ * read the same tables from plain global buffers instead.
+ */
+#ifdef USE_TEXTURE
+#define INT_TABLE  image1d_buffer_t
+#define INT2_TABLE image1d_buffer_t
+#define fetchInt(table, i)  read_imagei(table, i).x
+#define fetchInt2(table, i) read_imagei(table, i).xy
+#else
+#define INT_TABLE  global const int*
+#define INT2_TABLE global const int2*
+#define fetchInt(table, i)  (table)[i]
+#define fetchInt2(table, i) (table)[i]
+#endif
 
-__kernel void pfac(__global char* inputBuffer, __global char* inputPatterns, __global int* numOfPatterns, __global int* outputIndex ){ 
-	int idx = get_global_id(0);
-	int locationOffset =inputBuffer[idx]; ///position
-	
-	numOfPatterns[idx] = 2 ; 
-	outputIndex[idx] = locationOffset;
+/**
+ * Each Work Group of the pfacCompact kernel publishes the number of matches
+ * it found (workGroupSum) and, once known, the number of matches found by it
+ * and all preceding Work Groups (inclusivePrefix). -1 means not yet available.
+ */
+typedef struct WorkGroupSum_t {
+    int workGroupSum;
+    int inclusivePrefix;
+} WorkGroupSum;
 
-}
\ No newline at end of file
+/**
+ * The pfacCompact scan returns an array where each element represents a match
+ * and comprises the index within the input and the pattern ID of each match.
+ */
+typedef struct MatchEntry_t {
+    int index;
+    int value;
+} MatchEntry;
+
+/**
+ * 257 is the prime number used in the hash function and has the useful
+ * property that we can do reduction modulo 257 using (x & 255) - (x >> 8)
+ * http://mymathforum.com/number-theory/11914-calculate-10-7-mod-257-a.html
+ */
+static inline int mod257(int x) {
+    int mod = (x & 255) - (x >> 8);
+    if (mod < 0) {
+        mod += 257;
+    }
+    return mod;
+}
+
+/**
+ * Look up the next state in the hash table given the current state and the
+ * transition (input) character. Note that the initial transition is
+ * accessed separately via the initialTransitionsCache in the main Kernel code.
+ */
+static inline int lookup(INT2_TABLE hashRow,
+                         INT2_TABLE hashVal,
+                         int state,
+                         int inputChar) {
+    const int2 row = fetchInt2(hashRow, state); // hashRow[state]
+    const int offset  = row.x;
+    int nextState = INVALID;
+    if (offset >= 0) {
+        const int k_sminus1 = row.y;
+        const int sminus1 = k_sminus1 & MASK;
+        const int k = k_sminus1 >> MASKBITS;
+
+        const int p = mod257(k * inputChar) & sminus1;
+        const int2 value = fetchInt2(hashVal, offset + p); // hashVal[offset + p]
+        if (inputChar == value.x) {
+            nextState = value.y;
+        }
+    }
+    return nextState;
+}
+
+/**
+ * Copy the input of a Work Group, WORK_GROUP_SIZE + MAX_PATTERN_SIZE integers
+ * from global memory, and the initialTransitions table to local (shared) memory.
+ * n is the number of OpenCL integers that would completely contain the input bytes.
+ */
+static inline void loadInput(local int* initialTransitionsCache,
+                             local int* cache,
+                             INT_TABLE initialTransitions,
+                             global const int* input,
+                             int group,
+                             int n) {
+    const int tid = get_local_id(0);
+
+    // Load the initialTransitions table to local (shared) memory.
+    for (int i = tid; i < 256; i += WORK_GROUP_SIZE) {
+        initialTransitionsCache[i] = fetchInt(initialTransitions, i);
+    }
+
+    const int inputIndex = group * WORK_GROUP_SIZE + tid;
+    if (inputIndex < n) {
+        cache[tid] = input[inputIndex];
+    }
+
+    // Read extra input data as we need overlaps to mitigate boundary condition.
+    for (int i = tid; i < MAX_PATTERN_SIZE; i += WORK_GROUP_SIZE) {
+        const int extraIndex = (group + 1) * WORK_GROUP_SIZE + i;
+        if (extraIndex < n) {
+            cache[WORK_GROUP_SIZE + i] = input[extraIndex];
+        }
+    }
+}
+
+/**
+ * Transition the state machine from buffer[pos] until it fails and return the
+ * ID of the longest pattern starting there, or -1.
+ */
+static inline int longestMatch(local const unsigned char* buffer,
+                               int pos,
+                               int bufferSize,
+                               local const int* initialTransitionsCache,
+                               INT2_TABLE hashRow,
+                               INT2_TABLE hashVal,
+                               int initialState) {
+    int match = -1;
+    int inputChar = buffer[pos];
+    int nextState = initialTransitionsCache[inputChar];
+    if (nextState != INVALID) {
+        if (nextState < initialState) {
+            match = nextState;
+        }
+        pos = pos + 1;
+        while (pos < bufferSize) {
+            inputChar = buffer[pos];
+            nextState = lookup(hashRow, hashVal, nextState, inputChar);
+            if (nextState == INVALID) {
+                break;
+            }
+
+            if (nextState < initialState) {
+                match = nextState;
+            }
+            pos = pos + 1;
+        }
+    }
+    return match;
+}
+
+/**
+ * Simple PFAC Kernel. Copies WORK_GROUP_SIZE + MAX_PATTERN_SIZE integers from
+ * global memory to local (shared) memory for each Work Group (thread block)
+ * then transitions the state machine. Each Work Item handles four start
+ * positions and writes, for each of them, the ID of the longest pattern that
+ * starts there, or -1.
+ *
+ * NDRange: one Work Item per int of input, rounded up to a multiple of
+ * WORK_GROUP_SIZE. n is the number of ints that hold the inputSize bytes.
+ */
+__kernel void pfac(INT_TABLE initialTransitions, INT2_TABLE hashRow, INT2_TABLE hashVal, int initialState,
+                   global const int* input, global int* output, int inputSize, int n) {
+
+    // Calculate the index of the first character in the Work Group.
+    const int firstCharInWorkGroup = get_group_id(0) * WORK_GROUP_SIZE * sizeof(int);
+
+    // Calculate remaining characters, starting from firstCharInWorkGroup.
+    const int remaining = inputSize - firstCharInWorkGroup;
+
+    // Calculate the local memory buffer size in bytes, noting that the last
+    // work-group may contain fewer characters than the maximum buffer size.
+    const int MAX_BUFFER_SIZE = (WORK_GROUP_SIZE + MAX_PATTERN_SIZE) * sizeof(int);
+    const int bufferSize = min(remaining, MAX_BUFFER_SIZE);
+
+    const int tid = get_local_id(0); // Thread (Work Item) ID
+
+    int outputIndex = firstCharInWorkGroup + tid;
+
+    // Local (i.e. shared by all threads in the Work Group) memory arrays.
+    local int initialTransitionsCache[256];
+    local int cache[WORK_GROUP_SIZE + MAX_PATTERN_SIZE];
+    local unsigned char* buffer = (local unsigned char*)cache;
+
+    loadInput(initialTransitionsCache, cache, initialTransitions, input, get_group_id(0), n);
+
+    // Block until all Work Items in the Work Group have reached this point
+    // to ensure correct ordering of memory operations to local memory.
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Perform state machine look-up with each thread processing four characters.
+    #pragma unroll
+    for (int i = 0; i < 4; i++) {
+        const int pos = tid + i * WORK_GROUP_SIZE;
+
+        if (pos >= bufferSize || outputIndex >= inputSize) return;
+
+        // Output results to global memory
+        output[outputIndex] = longestMatch(buffer, pos, bufferSize, initialTransitionsCache, hashRow, hashVal, initialState);
+        outputIndex += WORK_GROUP_SIZE;
+    }
+}
+
+/**
+ * PFAC Kernel with compacted output. Matches like pfac, but writes only the
+ * positions that match, as MatchEntry pairs in increasing position order, and
+ * the total number of matches to numMatched. Intended for sparse matches,
+ * where copying back and walking the dense output dominates.
+ *
+ * The output offset of each Work Group is found in the same pass with a
+ * decoupled look-back: a Work Group publishes its match count in sums, then
+ * walks back over its predecessors adding their counts until it meets one
+ * whose inclusive prefix is already known. Work Groups take their number
+ * from groupCounter in the order they start, so every predecessor a Work
+ * Group waits for is already running and the wait always ends.
+ *
+ * The host sets every field of sums to -1 and groupCounter to 0 before the
+ * launch. NDRange as for pfac.
+ */
+__kernel void pfacCompact(INT_TABLE initialTransitions, INT2_TABLE hashRow, INT2_TABLE hashVal, int initialState,
+                          global const int* input, global MatchEntry* matches, volatile global WorkGroupSum* sums,
+                          volatile global int* groupCounter, global int* numMatched, int inputSize, int n) {
+
+    local int groupId;
+    local int exclusivePrefix;
+    local int initialTransitionsCache[256];
+    local int cache[WORK_GROUP_SIZE + MAX_PATTERN_SIZE];
+    local int matchCache[4 * WORK_GROUP_SIZE];
+    local int partial[WORK_GROUP_SIZE];
+    local unsigned char* buffer = (local unsigned char*)cache;
+
+    const int tid = get_local_id(0); // Thread (Work Item) ID
+
+    if (tid == 0) {
+        groupId = atomic_inc(groupCounter);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    const int group = groupId;
+
+    const int firstCharInWorkGroup = group * WORK_GROUP_SIZE * sizeof(int);
+    const int remaining = inputSize - firstCharInWorkGroup;
+    const int MAX_BUFFER_SIZE = (WORK_GROUP_SIZE + MAX_PATTERN_SIZE) * sizeof(int);
+    const int bufferSize = min(remaining, MAX_BUFFER_SIZE);
+
+    loadInput(initialTransitionsCache, cache, initialTransitions, input, group, n);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Same start positions as pfac. No early return: every Work Item takes part in the scan below.
+    for (int i = 0; i < 4; i++) {
+        const int pos = tid + i * WORK_GROUP_SIZE;
+        int match = -1;
+        if (pos < bufferSize && firstCharInWorkGroup + pos < inputSize) {
+            match = longestMatch(buffer, pos, bufferSize, initialTransitionsCache, hashRow, hashVal, initialState);
+        }
+        matchCache[pos] = match;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Each Work Item owns four consecutive positions; an inclusive scan over
+    // the per Work Item counts gives their offsets within the Work Group.
+    int count = 0;
+    for (int i = 0; i < 4; i++) {
+        count += matchCache[4 * tid + i] >= 0;
+    }
+    partial[tid] = count;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int offset = 1; offset < WORK_GROUP_SIZE; offset <<= 1) {
+        const int value = tid >= offset ? partial[tid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        partial[tid] += value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    const int aggregate = partial[WORK_GROUP_SIZE - 1];
+
+    if (tid == 0) {
+        int prefix = 0;
+        if (group == 0) {
+            atomic_xchg(&sums[0].inclusivePrefix, aggregate);
+        }
+        else {
+            atomic_xchg(&sums[group].workGroupSum, aggregate);
+            int previous = group - 1;
+            while (previous >= 0) {
+                const int inclusive = atomic_or(&sums[previous].inclusivePrefix, 0);
+                if (inclusive >= 0) {
+                    prefix += inclusive;
+                    break;
+                }
+                const int sum = atomic_or(&sums[previous].workGroupSum, 0);
+                if (sum >= 0) {
+                    prefix += sum;
+                    previous--;
+                }
+            }
+            atomic_xchg(&sums[group].inclusivePrefix, prefix + aggregate);
+        }
+        exclusivePrefix = prefix;
+        if (group == get_num_groups(0) - 1) {
+            *numMatched = prefix + aggregate;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int outputIndex = exclusivePrefix + partial[tid] - count;
+    for (int i = 0; i < 4; i++) {
+        const int pos = 4 * tid + i;
+        if (matchCache[pos] >= 0) {
+            matches[outputIndex].index = firstCharInWorkGroup + pos;
+            matches[outputIndex].value = matchCache[pos];
+            outputIndex++;
+        }
+    }
+}
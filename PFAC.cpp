@@ -0,0 +1,635 @@
+// Implementation of the PFAC.h library API on top of the compiled automaton.
+// A handle owns everything built from its pattern file, so matching calls only scan.
+
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "PFAC.h"
+#include "trie.h"
+#include "automaton.h"
+#include "pfac_table.h"
+#include "automaton_file.h"
+#ifndef PFAC_NO_OPENCL
+#include "pfac_ocl.h"
+#else
+// Built without OpenCL: the GPU platform reports PFAC_STATUS_LIB_NOT_EXIST.
+struct pfacDevice;
+#endif
+
+#ifndef PFAC_KERNEL_FILE
+#define PFAC_KERNEL_FILE "PFAC.cl"
+#endif
+
+// Input bytes per OpenMP task. Large enough that the walk past a block's end is negligible.
+#define PFAC_OMP_BLOCK_SIZE (64 * 1024)
+
+using namespace std;
+
+/**
+* State behind a PFAC_handle_t.
+* - dfa: Automaton compiled from the patterns; NULL until PFAC_readPatternFromFile() or
+*   PFAC_readAutomatonFromFile() succeeds, and after patterns are read in PFAC_SPACE_DRIVEN
+*   mode until the dense table is needed, see prepareDense().
+* - table: Hashed failureless tables for the pfac kernel and the PFAC_SPACE_DRIVEN CPU path.
+*   table.numStates is 0 until patterns are loaded.
+* - patterns: Patterns read in PFAC_SPACE_DRIVEN mode, kept to compile dfa from on demand;
+*   empty otherwise.
+* - automatonFile: Mapping that dfa and table point into after PFAC_readAutomatonFromFile().
+* - device: OpenCL device, created on the first GPU match.
+* - deviceReady: The device holds the tables of the current patterns.
+* - denseResult: Per position results of the CPU_OMP reduce, kept to avoid reallocating on every call.
+*/
+struct PFAC_context {
+	PFAC_platform_t platform;
+	PFAC_textureMode_t textureMode;
+	PFAC_perfMode_t perfMode;
+	automaton* dfa;
+	pfacTable table;
+	vector<string> patterns;
+	mappedFile automatonFile;
+	pfacDevice* device;
+	bool deviceReady;
+	vector<int> denseResult;
+};
+
+PFAC_status_t PFAC_create(PFAC_handle_t *handle) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_PARAMETER;
+	PFAC_context* ctx = new (nothrow) PFAC_context();
+	if (NULL == ctx) return PFAC_STATUS_ALLOC_FAILED;
+	ctx->platform = PFAC_PLATFORM_GPU;
+	ctx->textureMode = PFAC_AUTOMATIC;
+	ctx->perfMode = PFAC_TIME_DRIVEN;
+	ctx->dfa = NULL;
+	ctx->automatonFile.data = NULL;
+	ctx->automatonFile.size = 0;
+	ctx->device = NULL;
+	ctx->deviceReady = false;
+	*handle = ctx;
+	return PFAC_STATUS_SUCCESS;
+}
+
+PFAC_status_t PFAC_destroy(PFAC_handle_t handle) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+#ifndef PFAC_NO_OPENCL
+	if (handle->device) {
+		pfacOclRelease(handle->device);
+		delete handle->device;
+	}
+#endif
+	delete handle->dfa;
+	unmapFile(&handle->automatonFile);
+	delete handle;
+	return PFAC_STATUS_SUCCESS;
+}
+
+PFAC_status_t PFAC_setPlatform(PFAC_handle_t handle, PFAC_platform_t platform) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (platform != PFAC_PLATFORM_GPU && platform != PFAC_PLATFORM_CPU && platform != PFAC_PLATFORM_CPU_OMP) {
+		return PFAC_STATUS_INVALID_PARAMETER;
+	}
+	handle->platform = platform;
+	return PFAC_STATUS_SUCCESS;
+}
+
+PFAC_status_t PFAC_setTextureMode(PFAC_handle_t handle, PFAC_textureMode_t textureModeSel) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (textureModeSel != PFAC_AUTOMATIC && textureModeSel != PFAC_TEXTURE_ON && textureModeSel != PFAC_TEXTURE_OFF) {
+		return PFAC_STATUS_INVALID_PARAMETER;
+	}
+	if (handle->textureMode != textureModeSel) {
+		// The kernel is built for one table layout; rebuild it on the next GPU match.
+		handle->textureMode = textureModeSel;
+		handle->deviceReady = false;
+	}
+	return PFAC_STATUS_SUCCESS;
+}
+
+/**
+* PFAC_TIME_DRIVEN: the CPU backends walk the dense transition table of the automaton.
+* PFAC_SPACE_DRIVEN: they walk the hashed tables the pfac kernel uses instead. Patterns read
+* in this mode are hashed straight from the trie and the dense table, which takes
+* 4 * numClasses bytes per state, is not built at all unless the mode is switched back.
+* The GPU backend always uses the hashed tables.
+*/
+PFAC_status_t PFAC_setPerfMode(PFAC_handle_t handle, PFAC_perfMode_t perfModeSel) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (perfModeSel != PFAC_TIME_DRIVEN && perfModeSel != PFAC_SPACE_DRIVEN) {
+		return PFAC_STATUS_INVALID_PARAMETER;
+	}
+	handle->perfMode = perfModeSel;
+	return PFAC_STATUS_SUCCESS;
+}
+
+const char* PFAC_getErrorString(PFAC_status_t status) {
+	switch (status) {
+	case PFAC_STATUS_SUCCESS: return "PFAC_STATUS_SUCCESS: operation is successful";
+	case PFAC_STATUS_ALLOC_FAILED: return "PFAC_STATUS_ALLOC_FAILED: allocation of host memory failed";
+	case PFAC_STATUS_CUDA_ALLOC_FAILED: return "PFAC_STATUS_CUDA_ALLOC_FAILED: allocation of device memory or table images failed";
+	case PFAC_STATUS_INVALID_HANDLE: return "PFAC_STATUS_INVALID_HANDLE: handle is a NULL pointer, please call PFAC_create() first";
+	case PFAC_STATUS_INVALID_PARAMETER: return "PFAC_STATUS_INVALID_PARAMETER: invalid parameter";
+	case PFAC_STATUS_PATTERNS_NOT_READY: return "PFAC_STATUS_PATTERNS_NOT_READY: please call PFAC_readPatternFromFile() first";
+	case PFAC_STATUS_FILE_OPEN_ERROR: return "PFAC_STATUS_FILE_OPEN_ERROR: pattern or automaton file cannot be opened";
+	case PFAC_STATUS_LIB_NOT_EXIST: return "PFAC_STATUS_LIB_NOT_EXIST: no OpenCL platform with a usable device";
+	case PFAC_STATUS_ARCH_MISMATCH: return "PFAC_STATUS_ARCH_MISMATCH: device does not support the pfac kernel";
+	case PFAC_STATUS_MUTEX_ERROR: return "PFAC_STATUS_MUTEX_ERROR: mutex error";
+	case PFAC_STATUS_INTERNAL_ERROR: return "PFAC_STATUS_INTERNAL_ERROR: please report bugs";
+	default: return "unknown PFAC status";
+	}
+}
+
+/**
+* Read one pattern per line and compile them. Pattern IDs are line numbers among the
+* non-empty lines, starting at 0. Any previously loaded patterns are replaced.
+*/
+PFAC_status_t PFAC_readPatternFromFile(PFAC_handle_t handle, char *filename) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (NULL == filename) return PFAC_STATUS_INVALID_PARAMETER;
+
+	ifstream patternInput(filename, ifstream::in | ifstream::binary);
+	if (!patternInput.is_open()) return PFAC_STATUS_FILE_OPEN_ERROR;
+
+	try {
+		vector<string> patterns;
+		string buffer;
+		while (getline(patternInput, buffer)) {
+			if (!buffer.empty() && buffer[buffer.size() - 1] == '\r') buffer.erase(buffer.size() - 1);
+			if (!buffer.empty()) patterns.push_back(buffer);
+		}
+		patternInput.close();
+
+		// The trie is only needed to compile the automaton. Patterns may contain NUL bytes.
+		trieArena* stateMachine = trie(patterns);
+		defineFailures(stateMachine);
+		automaton* dfa = NULL;
+		pfacTable table;
+		try {
+			if (handle->perfMode == PFAC_SPACE_DRIVEN) {
+				buildPfacTable(stateMachine, patterns, table);
+			}
+			else {
+				dfa = compileAutomaton(stateMachine, patterns);
+				buildPfacTable(dfa, table);
+				patterns.clear();
+			}
+		}
+		catch (const bad_alloc&) {
+			deleteTrie(stateMachine);
+			delete dfa;
+			throw;
+		}
+		deleteTrie(stateMachine);
+
+		delete handle->dfa;
+		handle->dfa = dfa;
+		handle->table = table;
+		handle->patterns.swap(patterns);
+		unmapFile(&handle->automatonFile);
+		handle->deviceReady = false;
+	}
+	catch (const bad_alloc&) {
+		return PFAC_STATUS_ALLOC_FAILED;
+	}
+	return PFAC_STATUS_SUCCESS;
+}
+
+// Patterns have been read or an automaton file mapped.
+static bool patternsReady(const PFAC_context* ctx) {
+	return ctx->table.numStates > 0;
+}
+
+// Compile the dense automaton of patterns read in PFAC_SPACE_DRIVEN mode, once it is needed after all.
+static PFAC_status_t prepareDense(PFAC_context* ctx) {
+	if (ctx->dfa) return PFAC_STATUS_SUCCESS;
+	try {
+		trieArena* stateMachine = trie(ctx->patterns);
+		defineFailures(stateMachine);
+		try {
+			ctx->dfa = compileAutomaton(stateMachine, ctx->patterns);
+		}
+		catch (const bad_alloc&) {
+			deleteTrie(stateMachine);
+			throw;
+		}
+		deleteTrie(stateMachine);
+	}
+	catch (const bad_alloc&) {
+		return PFAC_STATUS_ALLOC_FAILED;
+	}
+	ctx->patterns.clear();
+	return PFAC_STATUS_SUCCESS;
+}
+
+// Make the tables the CPU platforms walk in the current perfMode available.
+static PFAC_status_t prepareHost(PFAC_context* ctx) {
+	return ctx->perfMode == PFAC_SPACE_DRIVEN ? PFAC_STATUS_SUCCESS : prepareDense(ctx);
+}
+
+/**
+* Write the compiled automaton and its PFAC tables in the binary format of automaton_file.h.
+* PFAC_readAutomatonFromFile() maps the file back without rebuilding anything. The format
+* holds the dense table, which is compiled first if the patterns were read in PFAC_SPACE_DRIVEN mode.
+*/
+PFAC_status_t PFAC_dumpTransitionTable(PFAC_handle_t handle, FILE *fp) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (NULL == fp) return PFAC_STATUS_INVALID_PARAMETER;
+	if (!patternsReady(handle)) return PFAC_STATUS_PATTERNS_NOT_READY;
+	PFAC_status_t status = prepareDense(handle);
+	if (PFAC_STATUS_SUCCESS != status) return status;
+
+	return saveAutomaton(fp, handle->dfa, handle->table) ? PFAC_STATUS_SUCCESS : PFAC_STATUS_INTERNAL_ERROR;
+}
+
+/**
+* Map an automaton file written by PFAC_dumpTransitionTable() and use it in place of
+* compiled patterns. The tables stay in the mapping until the patterns are replaced or
+* the handle is destroyed.
+*/
+PFAC_status_t PFAC_readAutomatonFromFile(PFAC_handle_t handle, char *filename) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (NULL == filename) return PFAC_STATUS_INVALID_PARAMETER;
+
+	automaton* dfa = new (nothrow) automaton();
+	if (NULL == dfa) return PFAC_STATUS_ALLOC_FAILED;
+	mappedFile file;
+	pfacTable table;
+	if (!loadAutomaton(filename, &file, dfa, table)) {
+		delete dfa;
+		return PFAC_STATUS_FILE_OPEN_ERROR;
+	}
+
+	delete handle->dfa;
+	handle->dfa = dfa;
+	handle->table = table;
+	handle->patterns.clear();
+	unmapFile(&handle->automatonFile);
+	handle->automatonFile = file;
+	handle->deviceReady = false;
+	return PFAC_STATUS_SUCCESS;
+}
+
+/**
+* Longest pattern starting at text[pos] in the dense table, or -1. Follows only trie edges,
+* which are the transitions that increase the depth. Reads up to maxPatternLength bytes, never past size.
+* table is the transition table of dfa, of either width of state IDs.
+*/
+template <typename stateT>
+static inline int denseLongestMatch(const automaton* dfa, const stateT* table, const char* text, size_t size, size_t pos) {
+	const int32_t* depth = dfa->depth.data();
+	const int32_t* finalPattern = dfa->finalPattern.data();
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+	int32_t match = -1;
+	int32_t state = 0;
+	for (; pos < size; pos++) {
+		int32_t next = table[state * numClasses + classOf[(uint8_t)text[pos]]];
+		if (depth[next] != depth[state] + 1) break;
+		state = next;
+		if (finalPattern[state] >= 0) match = finalPattern[state];
+	}
+	return match;
+}
+
+/**
+* Match the start positions [begin, end) of text on the calling thread.
+* A start position may look up to maxPatternLength - 1 bytes past end, never past size.
+*/
+static void matchRange(const PFAC_context* ctx, const char* text, size_t size, size_t begin, size_t end, int* result) {
+	if (ctx->perfMode == PFAC_SPACE_DRIVEN) {
+		for (size_t i = begin; i < end; i++) {
+			result[i] = pfacLongestMatch(ctx->table, text, size, i);
+		}
+		return;
+	}
+
+	const automaton* dfa = ctx->dfa;
+	if (!dfa->narrowTransitions.empty()) {
+		for (size_t i = begin; i < end; i++) result[i] = denseLongestMatch(dfa, dfa->narrowTransitions.data(), text, size, i);
+	}
+	else {
+		for (size_t i = begin; i < end; i++) result[i] = denseLongestMatch(dfa, dfa->transitions.data(), text, size, i);
+	}
+}
+
+// Create the OpenCL device on first use and upload the tables after the patterns or the texture mode changed.
+static PFAC_status_t prepareDevice(PFAC_context* ctx) {
+#ifdef PFAC_NO_OPENCL
+	(void)ctx;
+	return PFAC_STATUS_LIB_NOT_EXIST;
+#else
+	if (NULL == ctx->device) {
+		ctx->device = new (nothrow) pfacDevice();
+		if (NULL == ctx->device) return PFAC_STATUS_ALLOC_FAILED;
+		// Same device choice as the demo: a GPU if there is one, otherwise a CPU runtime such as POCL.
+		cl_int err = pfacOclCreate(ctx->device, CL_DEVICE_TYPE_GPU);
+		if (CL_SUCCESS != err) err = pfacOclCreate(ctx->device, CL_DEVICE_TYPE_CPU);
+		if (CL_SUCCESS != err) {
+			delete ctx->device;
+			ctx->device = NULL;
+			return PFAC_STATUS_LIB_NOT_EXIST;
+		}
+		ctx->deviceReady = false;
+	}
+	if (!ctx->deviceReady) {
+		ctx->device->textureMode = ctx->textureMode;
+		cl_int err = pfacOclLoadTable(ctx->device, ctx->table, PFAC_KERNEL_FILE);
+		if (CL_MEM_OBJECT_ALLOCATION_FAILURE == err || CL_OUT_OF_RESOURCES == err || CL_IMAGE_FORMAT_NOT_SUPPORTED == err) {
+			return PFAC_STATUS_CUDA_ALLOC_FAILED;
+		}
+		if (CL_INVALID_WORK_GROUP_SIZE == err) return PFAC_STATUS_ARCH_MISMATCH;
+		if (CL_SUCCESS != err) return PFAC_STATUS_INTERNAL_ERROR;
+		ctx->deviceReady = true;
+	}
+	return PFAC_STATUS_SUCCESS;
+#endif
+}
+
+#ifndef PFAC_NO_OPENCL
+// Map an OpenCL error of a match call to a PFAC status.
+static PFAC_status_t matchStatus(cl_int err) {
+	if (CL_MEM_OBJECT_ALLOCATION_FAILURE == err || CL_OUT_OF_RESOURCES == err || CL_INVALID_BUFFER_SIZE == err) {
+		return PFAC_STATUS_CUDA_ALLOC_FAILED;
+	}
+	return CL_SUCCESS == err ? PFAC_STATUS_SUCCESS : PFAC_STATUS_INTERNAL_ERROR;
+}
+
+// Longest pattern starting at text[pos], or -1, with the tables perfMode selects.
+static int matchAt(const PFAC_context* ctx, const char* text, size_t size, size_t pos) {
+	if (ctx->perfMode == PFAC_SPACE_DRIVEN || NULL == ctx->dfa) return pfacLongestMatch(ctx->table, text, size, pos);
+	const automaton* dfa = ctx->dfa;
+	if (!dfa->narrowTransitions.empty()) return denseLongestMatch(dfa, dfa->narrowTransitions.data(), text, size, pos);
+	return denseLongestMatch(dfa, dfa->transitions.data(), text, size, pos);
+}
+
+// Length of pattern id.
+static int32_t patternLengthOf(const PFAC_context* ctx, int32_t id) {
+	return ctx->dfa ? ctx->dfa->patternLength[id] : (int32_t)ctx->patterns[id].length();
+}
+#endif
+
+/**
+* h_matched_result[i] receives the ID of the longest pattern starting at h_inputString[i], or -1.
+* h_inputString does not need to be NULL terminated. On the GPU, input larger than
+* PFAC_PIPELINE_CHUNK_SIZE is matched in chunks, see pfacOclMatchPipelined().
+*/
+PFAC_status_t PFAC_matchFromHost(PFAC_handle_t handle, char *h_inputString, size_t size, int *h_matched_result) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (NULL == h_inputString || NULL == h_matched_result) return PFAC_STATUS_INVALID_PARAMETER;
+	if (!patternsReady(handle)) return PFAC_STATUS_PATTERNS_NOT_READY;
+	if (size == 0) return PFAC_STATUS_SUCCESS;
+
+	if (handle->platform == PFAC_PLATFORM_GPU) {
+		PFAC_status_t status = prepareDevice(handle);
+		if (PFAC_STATUS_SUCCESS != status) return status;
+#ifndef PFAC_NO_OPENCL
+		// Large inputs go through the pipeline, which overlaps transfers with matching and needs device memory for a few chunks only.
+		if (size > PFAC_PIPELINE_CHUNK_SIZE) {
+			return matchStatus(pfacOclMatchPipelined(handle->device, h_inputString, size, 0, h_matched_result));
+		}
+		return matchStatus(pfacOclMatch(handle->device, h_inputString, size, h_matched_result));
+#endif
+	}
+
+	PFAC_status_t status = prepareHost(handle);
+	if (PFAC_STATUS_SUCCESS != status) return status;
+	if (handle->platform == PFAC_PLATFORM_CPU) {
+		matchRange(handle, h_inputString, size, 0, size, h_matched_result);
+		return PFAC_STATUS_SUCCESS;
+	}
+
+	// PFAC_PLATFORM_CPU_OMP: every start position is independent, so blocks need no overlap handling.
+	const int numBlocks = (int)((size + PFAC_OMP_BLOCK_SIZE - 1) / PFAC_OMP_BLOCK_SIZE);
+	#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < numBlocks; b++) {
+		size_t begin = (size_t)b * PFAC_OMP_BLOCK_SIZE;
+		size_t end = begin + PFAC_OMP_BLOCK_SIZE < size ? begin + PFAC_OMP_BLOCK_SIZE : size;
+		matchRange(handle, h_inputString, size, begin, end, h_matched_result);
+	}
+	return PFAC_STATUS_SUCCESS;
+}
+
+/**
+* The CPU platforms share host memory, so device pointers are host pointers there.
+* On the GPU platform the OpenCL input lives in cl_mem objects, which this pointer based
+* interface cannot address; use PFAC_matchFromHost() instead.
+*/
+PFAC_status_t PFAC_matchFromDevice(PFAC_handle_t handle, char *d_inputString, size_t size, int *d_matched_result) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (handle->platform == PFAC_PLATFORM_GPU) return PFAC_STATUS_INVALID_PARAMETER;
+	return PFAC_matchFromHost(handle, d_inputString, size, d_matched_result);
+}
+
+/**
+* Compacted output: for k < *h_num_matched, pattern h_matched_result[k] starts at h_pos[k],
+* in increasing position order. Both arrays must hold size entries.
+* - GPU: the pfacCompact kernel compacts on the device; only the matches are copied back.
+* - CPU: one pass, compacting in place behind the match position.
+* - CPU_OMP: blocks are matched and counted in parallel, an exclusive prefix sum over the
+*   block counts gives every block its output offset, and the blocks then write their
+*   matches in parallel.
+*/
+PFAC_status_t PFAC_matchFromHostReduce(PFAC_handle_t handle, char *h_inputString, size_t size,
+	int *h_matched_result, int *h_pos, int *h_num_matched) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (NULL == h_inputString || NULL == h_matched_result || NULL == h_pos || NULL == h_num_matched) return PFAC_STATUS_INVALID_PARAMETER;
+	if (!patternsReady(handle)) return PFAC_STATUS_PATTERNS_NOT_READY;
+	if (size > 0x7fffffff) return PFAC_STATUS_INVALID_PARAMETER;
+	*h_num_matched = 0;
+	if (size == 0) return PFAC_STATUS_SUCCESS;
+
+	if (handle->platform == PFAC_PLATFORM_GPU) {
+		PFAC_status_t status = prepareDevice(handle);
+		if (PFAC_STATUS_SUCCESS != status) return status;
+#ifndef PFAC_NO_OPENCL
+		return matchStatus(pfacOclMatchCompact(handle->device, h_inputString, size, h_matched_result, h_pos, h_num_matched));
+#endif
+	}
+
+	PFAC_status_t status = prepareHost(handle);
+	if (PFAC_STATUS_SUCCESS != status) return status;
+	if (handle->platform == PFAC_PLATFORM_CPU) {
+		matchRange(handle, h_inputString, size, 0, size, h_matched_result);
+		// In place: the write index never passes the read index.
+		int numMatched = 0;
+		for (size_t i = 0; i < size; i++) {
+			if (h_matched_result[i] >= 0) {
+				h_matched_result[numMatched] = h_matched_result[i];
+				h_pos[numMatched] = (int)i;
+				numMatched++;
+			}
+		}
+		*h_num_matched = numMatched;
+		return PFAC_STATUS_SUCCESS;
+	}
+
+	try {
+		handle->denseResult.resize(size);
+	}
+	catch (const bad_alloc&) {
+		return PFAC_STATUS_ALLOC_FAILED;
+	}
+	int* dense = handle->denseResult.data();
+	const int numBlocks = (int)((size + PFAC_OMP_BLOCK_SIZE - 1) / PFAC_OMP_BLOCK_SIZE);
+	vector<int> blockOffset(numBlocks + 1, 0);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < numBlocks; b++) {
+		size_t begin = (size_t)b * PFAC_OMP_BLOCK_SIZE;
+		size_t end = begin + PFAC_OMP_BLOCK_SIZE < size ? begin + PFAC_OMP_BLOCK_SIZE : size;
+		matchRange(handle, h_inputString, size, begin, end, dense);
+		int count = 0;
+		for (size_t i = begin; i < end; i++) {
+			count += dense[i] >= 0;
+		}
+		blockOffset[b + 1] = count;
+	}
+
+	for (int b = 0; b < numBlocks; b++) {
+		blockOffset[b + 1] += blockOffset[b];
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (int b = 0; b < numBlocks; b++) {
+		size_t begin = (size_t)b * PFAC_OMP_BLOCK_SIZE;
+		size_t end = begin + PFAC_OMP_BLOCK_SIZE < size ? begin + PFAC_OMP_BLOCK_SIZE : size;
+		int k = blockOffset[b];
+		for (size_t i = begin; i < end; i++) {
+			if (dense[i] >= 0) {
+				h_matched_result[k] = dense[i];
+				h_pos[k] = (int)i;
+				k++;
+			}
+		}
+	}
+	*h_num_matched = blockOffset[numBlocks];
+	return PFAC_STATUS_SUCCESS;
+}
+
+PFAC_status_t PFAC_matchFromDeviceReduce(PFAC_handle_t handle, char *d_inputString, size_t size,
+	int *d_matched_result, int *d_pos, int *h_num_matched) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (handle->platform == PFAC_PLATFORM_GPU) return PFAC_STATUS_INVALID_PARAMETER;
+	return PFAC_matchFromHostReduce(handle, d_inputString, size, d_matched_result, d_pos, h_num_matched);
+}
+
+/**
+* GPU: the records are packed back to back and matched by one pfacCompact launch. A match
+* found there may run on into the next record; only those, which start within
+* maxPatternLength - 1 bytes of their record's end, are matched again on the host, within
+* the record.
+* CPU platforms: every record is matched on its own, records in parallel on CPU_OMP, and
+* the results are compacted in record order like in PFAC_matchFromHostReduce().
+*/
+PFAC_status_t PFAC_matchRecords(PFAC_handle_t handle, const PFAC_record_t *records, int numRecords,
+	int *h_matched_result, int *h_record, int *h_pos, int *h_num_matched) {
+	if (NULL == handle) return PFAC_STATUS_INVALID_HANDLE;
+	if (numRecords < 0 || (NULL == records && numRecords > 0) || NULL == h_matched_result || NULL == h_record ||
+		NULL == h_pos || NULL == h_num_matched) {
+		return PFAC_STATUS_INVALID_PARAMETER;
+	}
+	if (!patternsReady(handle)) return PFAC_STATUS_PATTERNS_NOT_READY;
+	*h_num_matched = 0;
+
+	// recordOffset[r]: Position of record r in the packed batch.
+	vector<size_t> recordOffset;
+	vector<int> recordCount;
+	try {
+		recordOffset.assign(numRecords + 1, 0);
+		recordCount.assign(numRecords + 1, 0);
+	}
+	catch (const bad_alloc&) {
+		return PFAC_STATUS_ALLOC_FAILED;
+	}
+	for (int r = 0; r < numRecords; r++) {
+		if (NULL == records[r].data && records[r].size > 0) return PFAC_STATUS_INVALID_PARAMETER;
+		recordOffset[r + 1] = recordOffset[r] + records[r].size;
+	}
+	size_t total = recordOffset[numRecords];
+	if (total > 0x7fffffff) return PFAC_STATUS_INVALID_PARAMETER;
+	if (total == 0) return PFAC_STATUS_SUCCESS;
+
+	if (handle->platform == PFAC_PLATFORM_GPU) {
+		PFAC_status_t status = prepareDevice(handle);
+		if (PFAC_STATUS_SUCCESS != status) return status;
+#ifndef PFAC_NO_OPENCL
+		vector<char> packed;
+		try {
+			packed.resize(total);
+		}
+		catch (const bad_alloc&) {
+			return PFAC_STATUS_ALLOC_FAILED;
+		}
+		for (int r = 0; r < numRecords; r++) {
+			if (records[r].size > 0) memcpy(packed.data() + recordOffset[r], records[r].data, records[r].size);
+		}
+		int numMatched = 0;
+		status = matchStatus(pfacOclMatchCompact(handle->device, packed.data(), total, h_matched_result, h_pos, &numMatched));
+		if (PFAC_STATUS_SUCCESS != status) return status;
+
+		// Positions are increasing, so the records are walked once. In place: the write index never passes the read index.
+		int r = 0;
+		int k = 0;
+		for (int j = 0; j < numMatched; j++) {
+			size_t packedPos = (size_t)h_pos[j];
+			while (recordOffset[r + 1] <= packedPos) r++;
+			size_t pos = packedPos - recordOffset[r];
+			int match = h_matched_result[j];
+			if (pos + patternLengthOf(handle, match) > records[r].size) {
+				match = matchAt(handle, records[r].data, records[r].size, pos);
+				if (match < 0) continue;
+			}
+			h_matched_result[k] = match;
+			h_record[k] = r;
+			h_pos[k] = (int)pos;
+			k++;
+		}
+		*h_num_matched = k;
+		return PFAC_STATUS_SUCCESS;
+#endif
+	}
+
+	PFAC_status_t status = prepareHost(handle);
+	if (PFAC_STATUS_SUCCESS != status) return status;
+	try {
+		handle->denseResult.resize(total);
+	}
+	catch (const bad_alloc&) {
+		return PFAC_STATUS_ALLOC_FAILED;
+	}
+	int* dense = handle->denseResult.data();
+	const bool parallel = handle->platform == PFAC_PLATFORM_CPU_OMP;
+
+	#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+	for (int r = 0; r < numRecords; r++) {
+		int* recordResult = dense + recordOffset[r];
+		matchRange(handle, records[r].data, records[r].size, 0, records[r].size, recordResult);
+		int count = 0;
+		for (size_t i = 0; i < records[r].size; i++) {
+			count += recordResult[i] >= 0;
+		}
+		recordCount[r + 1] = count;
+	}
+
+	for (int r = 0; r < numRecords; r++) {
+		recordCount[r + 1] += recordCount[r];
+	}
+
+	#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+	for (int r = 0; r < numRecords; r++) {
+		const int* recordResult = dense + recordOffset[r];
+		int k = recordCount[r];
+		for (size_t i = 0; i < records[r].size; i++) {
+			if (recordResult[i] >= 0) {
+				h_matched_result[k] = recordResult[i];
+				h_record[k] = r;
+				h_pos[k] = (int)i;
+				k++;
+			}
+		}
+	}
+	*h_num_matched = recordCount[numRecords];
+	return PFAC_STATUS_SUCCESS;
+}
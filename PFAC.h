@@ -73,6 +73,14 @@ struct PFAC_context ;
 
 typedef struct PFAC_context* PFAC_handle_t ;
 
+/*
+ *  One input of a batch for PFAC_matchRecords(): size bytes at data, not NULL terminated.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+} PFAC_record_t ;
+
 /*
  *  return
  *  ------
@@ -120,6 +128,10 @@ PFAC_status_t  PFAC_setTextureMode( PFAC_handle_t handle, PFAC_textureMode_t tex
 
 
 /*
+ *  PFAC_TIME_DRIVEN matches on the CPU with a dense transition table. PFAC_SPACE_DRIVEN
+ *  uses the hashed tables of the GPU kernel instead; select it before PFAC_readPatternFromFile()
+ *  to never build the dense table, for pattern sets too large for it.
+ *
  *  return
  *  ------
  *  PFAC_STATUS_SUCCESS            if operation is successful
@@ -139,10 +151,17 @@ PFAC_status_t  PFAC_setPerfMode( PFAC_handle_t handle, PFAC_perfMode_t perfModeS
 const char* PFAC_getErrorString( PFAC_status_t status ) ;
 
 /*
+ *  Writes the compiled automaton and the PFAC tables in a versioned binary format
+ *  (see automaton_file.h). fp must be opened in binary mode. PFAC_readAutomatonFromFile()
+ *  loads the file without compiling the patterns again.
+ *
  *  return
  *  ------
  *  PFAC_STATUS_SUCCESS            if operation is successful
- *  PFAC_STATUS_INTERNAL_ERROR     please report bugs
+ *  PFAC_STATUS_INVALID_HANDLE     if "handle" is a NULL pointer
+ *  PFAC_STATUS_INVALID_PARAMETER  if "fp" is a NULL pointer
+ *  PFAC_STATUS_PATTERNS_NOT_READY if patterns are not loaded first
+ *  PFAC_STATUS_INTERNAL_ERROR     if writing fails
  *
  */
 PFAC_status_t  PFAC_dumpTransitionTable( PFAC_handle_t handle, FILE *fp ) ;
@@ -165,6 +184,23 @@ PFAC_status_t  PFAC_dumpTransitionTable( PFAC_handle_t handle, FILE *fp ) ;
  */
 PFAC_status_t  PFAC_readPatternFromFile( PFAC_handle_t handle, char *filename ) ;
 
+/*
+ *  Memory-maps a file written by PFAC_dumpTransitionTable() and uses it in place of
+ *  PFAC_readPatternFromFile(). Nothing is parsed or copied, so this takes about the same
+ *  time for any number of patterns.
+ *
+ *  return
+ *  ------
+ *  PFAC_STATUS_SUCCESS             if operation is successful
+ *  PFAC_STATUS_INVALID_HANDLE      if "handle" is a NULL pointer
+ *  PFAC_STATUS_INVALID_PARAMETER   if "filename" is a NULL pointer
+ *  PFAC_STATUS_FILE_OPEN_ERROR     if file "filename" cannot be mapped, or is not an automaton
+ *                                  file of this version written on a machine of the same byte order
+ *  PFAC_STATUS_ALLOC_FAILED        if host memory is not enough
+ *
+ */
+PFAC_status_t  PFAC_readAutomatonFromFile( PFAC_handle_t handle, char *filename ) ;
+
 /*
  *  return
  *  ------
@@ -214,6 +250,21 @@ PFAC_status_t  PFAC_matchFromDeviceReduce( PFAC_handle_t handle, char *d_inputSt
 PFAC_status_t  PFAC_matchFromHostReduce( PFAC_handle_t handle, char *h_inputString, size_t size,
     int *h_matched_result, int *h_pos, int *h_num_matched ) ;
 
+/*
+ *  Matches a batch of records in one call, each on its own: no match spans two records.
+ *  For k < *h_num_matched, pattern h_matched_result[k] is the longest one starting at
+ *  position h_pos[k] of record h_record[k], ordered by record and then position. The three
+ *  arrays must hold as many entries as the records have bytes in total, at most 2^31 - 1.
+ *  The GPU platform matches the whole batch in one kernel launch.
+ *
+ *  return
+ *  ------
+ *  The same as PFAC_matchFromHostReduce(); PFAC_STATUS_INVALID_PARAMETER also if "records"
+ *  is a NULL pointer or numRecords is negative
+ */
+PFAC_status_t  PFAC_matchRecords( PFAC_handle_t handle, const PFAC_record_t *records, int numRecords,
+    int *h_matched_result, int *h_record, int *h_pos, int *h_num_matched ) ;
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,31 @@
+// Aligned host allocations on every platform: _aligned_malloc on Windows, posix_memalign
+// elsewhere. Buffers handed to OpenCL are page aligned so a runtime can use them in place.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/**
+* Allocate size bytes aligned to alignment, a power of two and a multiple of sizeof(void*).
+* Returns NULL if the allocation fails. Release the memory with alignedFree().
+*/
+inline void* alignedMalloc(size_t size, size_t alignment) {
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	void* memory = NULL;
+	return posix_memalign(&memory, alignment, size) == 0 ? memory : NULL;
+#endif
+}
+
+inline void alignedFree(void* memory) {
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
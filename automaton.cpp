@@ -0,0 +1,464 @@
+#include <algorithm>
+
+#include "automaton.h"
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define PREFETCH(address) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#else
+#define PREFETCH(address) __builtin_prefetch(address)
+#endif
+
+using namespace std;
+
+/**
+* Compute the byte -> character class map for a pattern set. Every byte that occurs in
+* some pattern gets a class of its own; all other bytes share class 0, which can never
+* extend a match. This keeps the transition table as narrow as the pattern alphabet
+* while matching stays exact over all 256 byte values.
+* Returns the number of classes.
+*/
+int32_t buildClassMap(const vector<string>& patterns, uint8_t classOf[256]) {
+	bool used[256] = { false };
+	for (size_t i = 0; i < patterns.size(); i++) {
+		for (size_t j = 0; j < patterns[i].length(); j++) {
+			used[(uint8_t)patterns[i][j]] = true;
+		}
+	}
+	int32_t numClasses = 1;
+	for (int b = 0; b < 256; b++) {
+		if (used[b]) numClasses++;
+	}
+	// With every byte in use there is no class 0 and the map is the identity.
+	bool identity = (numClasses > 256);
+	numClasses = identity ? 0 : 1;
+	for (int b = 0; b < 256; b++) {
+		classOf[b] = (used[b] || identity) ? numClasses++ : 0;
+	}
+	return numClasses;
+}
+
+/**
+* Flatten the trie built by constructStateMachine() into a DFA.
+* States are numbered in BFS order, so the failure node of a state always has a
+* smaller number and its row is complete by the time the state itself is filled in:
+* a row starts as a copy of the failure node's row and the node's own children are
+* then written over it. See compileAutomatonParallel() for the multi-threaded version.
+* Input params:
+* - tree: Trie with failure links already defined.
+* - patterns: Patterns the trie was built from. Their indices become the pattern IDs.
+*/
+automaton* compileAutomaton(const trieArena* tree, const vector<string>& patterns) {
+	if (!tree) return NULL;
+	automatonBuild build;
+	beginAutomaton(tree, patterns, build);
+	for (int32_t s = 0; s < build.dfa->numStates; s++) {
+		compileState(tree, build, s);
+	}
+	return finishAutomaton(tree, build);
+}
+
+/**
+* First step of compileAutomaton(): set the scalars and the class map, number the states in
+* BFS order and allocate the tables.
+* Input params:
+* - tree: Trie with failure links already defined.
+* - patterns: Patterns the trie was built from. Their indices become the pattern IDs.
+* - build: Receives the automaton being built.
+*/
+void beginAutomaton(const trieArena* tree, const vector<string>& patterns, automatonBuild& build) {
+	const vector<node>& nodes = tree->nodes;
+	automaton* dfa = new automaton();
+	build.dfa = dfa;
+	dfa->numClasses = buildClassMap(patterns, dfa->classOf);
+	dfa->numPatterns = patterns.size();
+	dfa->maxPatternLength = 0;
+	for (int32_t i = 0; i < dfa->numPatterns; i++) {
+		build.patternLength.push_back(patterns[i].length());
+		if ((int32_t)patterns[i].length() > dfa->maxPatternLength) {
+			dfa->maxPatternLength = patterns[i].length();
+		}
+	}
+
+	// Number the states in BFS order; the depths only ever grow along it.
+	vector<uint32_t>& order = build.order;
+	vector<int32_t>& depth = build.depth;
+	build.stateOf.assign(nodes.size(), 0);
+	order.reserve(nodes.size());
+	depth.reserve(nodes.size());
+	order.push_back(0);
+	depth.push_back(0);
+	build.levelStart.push_back(0);
+	for (size_t k = 0; k < order.size(); k++) {
+		if (depth[k] == (int32_t)build.levelStart.size()) build.levelStart.push_back(k);
+		for (uint32_t child = nodes[order[k]].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+			build.stateOf[child] = order.size();
+			order.push_back(child);
+			depth.push_back(depth[k] + 1);
+		}
+	}
+	dfa->numStates = order.size();
+	build.levelStart.push_back(dfa->numStates);
+
+	build.transitions.resize((size_t)dfa->numStates * dfa->numClasses);
+	build.outputLink.resize(dfa->numStates);
+	build.finalPattern.resize(dfa->numStates);
+}
+
+/**
+* Fill in the row, output link and patterns of state s. The rows of all shallower states
+* must be complete; states of one depth can be compiled at the same time.
+* Input params:
+* - tree: Trie passed to beginAutomaton()
+* - build: Automaton being built
+* - s: State to compile
+*/
+void compileState(const trieArena* tree, automatonBuild& build, int32_t s) {
+	const vector<node>& nodes = tree->nodes;
+	const size_t numClasses = build.dfa->numClasses;
+	const uint8_t* classOf = build.dfa->classOf;
+	const node& n = nodes[build.order[s]];
+	int32_t* row = &build.transitions[(size_t)s * numClasses];
+	if (s > 0) {
+		const int32_t* failureRow = &build.transitions[(size_t)build.stateOf[n.failure] * numClasses];
+		copy(failureRow, failureRow + numClasses, row);
+	}
+	else {
+		fill(row, row + numClasses, 0);
+	}
+	for (uint32_t child = n.firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+		row[classOf[nodes[child].label]] = build.stateOf[child];
+	}
+
+	// Only the node's own patterns; those of its suffixes are reached through outputLink.
+	build.finalPattern[s] = n.firstPattern;
+	build.outputLink[s] = (n.outputLink == NO_NODE) ? -1 : build.stateOf[n.outputLink];
+}
+
+/**
+* Last step of compileAutomaton(): move the tables into the automaton once every state is compiled.
+* Input params:
+* - tree: Trie passed to beginAutomaton()
+* - build: Automaton being built; its tables are taken over.
+* Returns the automaton.
+*/
+automaton* finishAutomaton(const trieArena* tree, automatonBuild& build) {
+	automaton* dfa = build.dfa;
+	// The chains of identical patterns are the trie's, which numbers patterns the same way.
+	vector<int32_t> nextPattern(tree->nextPattern.begin(), tree->nextPattern.end());
+
+	setTransitions(dfa, build.transitions);
+	dfa->outputLink.assign(build.outputLink);
+	dfa->depth.assign(build.depth);
+	dfa->patternLength.assign(build.patternLength);
+	dfa->finalPattern.assign(build.finalPattern);
+	dfa->nextPattern.assign(nextPattern);
+	initPrefilter(dfa);
+	build.dfa = NULL;
+	return dfa;
+}
+
+/**
+* Derive the prefilter from the root row of the transition table. It stays disabled when
+* the root reports matches itself (an empty pattern), as every position then matches.
+*/
+void initPrefilter(automaton* dfa) {
+	bool isStart[256];
+	for (int b = 0; b < 256; b++) isStart[b] = transitionOf(dfa, 0, dfa->classOf[b]) != 0;
+	buildFirstByteFilter(isStart, &dfa->prefilter);
+	if (dfa->finalPattern[0] >= 0) dfa->prefilter.enabled = false;
+}
+
+/**
+* Store the transition table a builder filled with 32-bit state IDs, in 16-bit state IDs if
+* the automaton has few enough states. Most rule sets compile to far fewer than
+* NARROW_MAX_STATES states; rows half as wide keep twice as many of them in L1 and L2, and
+* the automaton and its file take half the table memory. Larger automata keep the 32-bit table.
+* Input params:
+* - dfa: Automaton with numStates and numClasses set
+* - table: numStates x numClasses table; it is taken over or released.
+*/
+void setTransitions(automaton* dfa, vector<int32_t>& table) {
+	vector<int32_t> wide;
+	vector<uint16_t> narrow;
+	if (dfa->numStates <= NARROW_MAX_STATES) {
+		narrow.assign(table.begin(), table.end());
+		vector<int32_t>().swap(table);
+	}
+	else {
+		wide.swap(table);
+	}
+	dfa->transitions.assign(wide);
+	dfa->narrowTransitions.assign(narrow);
+}
+
+// Copy row state of the transition table into row, with 32-bit state IDs, for builders.
+void transitionRow(const automaton* dfa, int32_t state, int32_t* row) {
+	size_t begin = (size_t)state * dfa->numClasses;
+	if (dfa->narrowTransitions.empty()) copy(dfa->transitions.begin() + begin, dfa->transitions.begin() + begin + dfa->numClasses, row);
+	else copy(dfa->narrowTransitions.begin() + begin, dfa->narrowTransitions.begin() + begin + dfa->numClasses, row);
+}
+
+// Body of scanAutomatonFrom(), for either width of state IDs in table.
+template <typename stateT>
+static int32_t scanFrom(const automaton* dfa, const stateT* table, int32_t state, const char* text, size_t len, int64_t locationOffset, vector<matchEntry>& result) {
+	const int32_t* finalPattern = dfa->finalPattern.data();
+	const int32_t* nextPattern = dfa->nextPattern.data();
+	const int32_t* outputLink = dfa->outputLink.data();
+	const int32_t* patternLength = dfa->patternLength.data();
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+	const firstByteFilter* filter = dfa->prefilter.enabled ? &dfa->prefilter : NULL;
+
+	for (size_t i = 0; i < len; i++) {
+		// In the root state, bytes that cannot start a match change nothing; skip them.
+		if (0 == state && filter && !filter->isStart[(uint8_t)text[i]]) {
+			i = nextCandidate(filter, text, i, len);
+			if (i == len) break;
+		}
+		state = table[state * numClasses + classOf[(uint8_t)text[i]]];
+		// The state's own patterns, then those of its suffixes along the output links.
+		for (int32_t out = state; out >= 0; out = outputLink[out]) {
+			for (int32_t p = finalPattern[out]; p >= 0; p = nextPattern[p]) {
+				matchEntry m;
+				m.pattern = p;
+				m.position = locationOffset + (int64_t)i + 1 - patternLength[m.pattern];
+				result.push_back(m);
+			}
+		}
+	}
+	return state;
+}
+
+/**
+* Scan text with a compiled automaton, starting from the given state.
+* Input params:
+* - dfa: Automaton built by compileAutomaton()
+* - state: State to start in; 0 is the root.
+* - text: Input text, does not need to be NULL terminated and may contain NUL bytes
+* - len: Number of bytes to scan
+* - locationOffset: Offset value added to every reported location.
+* - result: Matches are appended in the order they end in the text. Callers scanning repeatedly
+*   should clear() and reuse one vector, so it stops allocating once it has grown to fit.
+* Returns the state after the last byte, to continue scanning from.
+*/
+int32_t scanAutomatonFrom(const automaton* dfa, int32_t state, const char* text, size_t len, int64_t locationOffset, vector<matchEntry>& result) {
+	if (!dfa->narrowTransitions.empty()) return scanFrom(dfa, dfa->narrowTransitions.data(), state, text, len, locationOffset, result);
+	return scanFrom(dfa, dfa->transitions.data(), state, text, len, locationOffset, result);
+}
+
+// Scan text on its own, starting from the root state. See scanAutomatonFrom().
+void scanAutomaton(const automaton* dfa, const char* text, size_t len, int64_t locationOffset, vector<matchEntry>& result) {
+	scanAutomatonFrom(dfa, 0, text, len, locationOffset, result);
+}
+
+void streamInit(scanStream* stream, const automaton* dfa) {
+	stream->dfa = dfa;
+	stream->state = 0;
+	stream->offset = 0;
+}
+
+/**
+* Scan the next block of a stream. A match is reported in the block it ends in, with the
+* stream offset of its first character, which may lie in an earlier block.
+*/
+void streamScan(scanStream* stream, const char* block, size_t len, vector<matchEntry>& result) {
+	stream->state = scanAutomatonFrom(stream->dfa, stream->state, block, len, stream->offset, result);
+	stream->offset += len;
+}
+
+template <typename stateT>
+static int32_t advanceFrom(const automaton* dfa, const stateT* table, int32_t state, const char* text, size_t len) {
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+
+	for (size_t i = 0; i < len; i++) {
+		state = table[state * numClasses + classOf[(uint8_t)text[i]]];
+	}
+	return state;
+}
+
+// Run the automaton over text without reporting matches. Returns the state after the last byte.
+int32_t advanceAutomaton(const automaton* dfa, int32_t state, const char* text, size_t len) {
+	if (!dfa->narrowTransitions.empty()) return advanceFrom(dfa, dfa->narrowTransitions.data(), state, text, len);
+	return advanceFrom(dfa, dfa->transitions.data(), state, text, len);
+}
+
+template <typename stateT>
+static int32_t countFrom(const automaton* dfa, const stateT* table, int32_t state, const char* text, size_t len, int64_t* counts) {
+	const int32_t* finalPattern = dfa->finalPattern.data();
+	const int32_t* nextPattern = dfa->nextPattern.data();
+	const int32_t* outputLink = dfa->outputLink.data();
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+	const firstByteFilter* filter = dfa->prefilter.enabled ? &dfa->prefilter : NULL;
+
+	for (size_t i = 0; i < len; i++) {
+		if (0 == state && filter && !filter->isStart[(uint8_t)text[i]]) {
+			i = nextCandidate(filter, text, i, len);
+			if (i == len) break;
+		}
+		state = table[state * numClasses + classOf[(uint8_t)text[i]]];
+		for (int32_t out = state; out >= 0; out = outputLink[out]) {
+			for (int32_t p = finalPattern[out]; p >= 0; p = nextPattern[p]) {
+				counts[p]++;
+			}
+		}
+	}
+	return state;
+}
+
+/**
+* Count matches per pattern instead of reporting them, for callers that only need hit
+* counts. No memory is allocated, however many matches the text holds.
+* Input params:
+* - dfa: Automaton built by compileAutomaton()
+* - state: State to start in; 0 is the root.
+* - text: Input text, does not need to be NULL terminated and may contain NUL bytes
+* - len: Number of bytes to scan
+* - counts: numPatterns counters; counts[p] is incremented for every match of pattern p.
+* Returns the state after the last byte, to continue scanning from.
+*/
+int32_t countAutomatonFrom(const automaton* dfa, int32_t state, const char* text, size_t len, int64_t* counts) {
+	if (!dfa->narrowTransitions.empty()) return countFrom(dfa, dfa->narrowTransitions.data(), state, text, len, counts);
+	return countFrom(dfa, dfa->transitions.data(), state, text, len, counts);
+}
+
+// Count the matches in text on its own, starting from the root state. See countAutomatonFrom().
+void countAutomaton(const automaton* dfa, const char* text, size_t len, int64_t* counts) {
+	countAutomatonFrom(dfa, 0, text, len, counts);
+}
+
+// Count the matches ending in the next block of a stream. See streamScan() and countAutomatonFrom().
+void streamCount(scanStream* stream, const char* block, size_t len, int64_t* counts) {
+	stream->state = countAutomatonFrom(stream->dfa, stream->state, block, len, counts);
+	stream->offset += len;
+}
+
+/**
+* Split text into numStreams equal lanes for the interleaved scanners. Lane k owns the
+* bytes [begin[k], begin[k] + size[k]) and starts in the state reached by running the
+* automaton over the maxPatternLength - 1 bytes before it, which is enough to see every
+* match that ends in the lane. Returns the number of bytes every lane has.
+*/
+static size_t splitLanes(const automaton* dfa, const char* text, size_t len, int numStreams, size_t* begin, size_t* size, int32_t* state) {
+	size_t laneSize = (len + numStreams - 1) / numStreams;
+	size_t overlap = dfa->maxPatternLength > 0 ? dfa->maxPatternLength - 1 : 0;
+	size_t common = laneSize;
+	for (int k = 0; k < numStreams; k++) {
+		begin[k] = min(laneSize * k, len);
+		size[k] = min(laneSize, len - begin[k]);
+		size_t warmUp = min(begin[k], overlap);
+		state[k] = advanceAutomaton(dfa, 0, text + begin[k] - warmUp, warmUp);
+		common = min(common, size[k]);
+	}
+	return common;
+}
+
+// Body of scanInterleaved(), for either width of state IDs in table.
+template <typename stateT>
+static void scanLanes(const automaton* dfa, const stateT* table, const char* text, size_t len, int64_t locationOffset, int numStreams, vector<matchEntry>& result) {
+	const int32_t* finalPattern = dfa->finalPattern.data();
+	const int32_t* nextPattern = dfa->nextPattern.data();
+	const int32_t* outputLink = dfa->outputLink.data();
+	const int32_t* patternLength = dfa->patternLength.data();
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+
+	size_t begin[MAX_STREAMS], size[MAX_STREAMS];
+	int32_t state[MAX_STREAMS];
+	size_t common = splitLanes(dfa, text, len, numStreams, begin, size, state);
+
+	// Lane 0 reports straight into result; the others are appended after it, in lane order.
+	vector<vector<matchEntry>> laneResults(numStreams - 1);
+	for (size_t i = 0; i < common; i++) {
+		for (int k = 0; k < numStreams; k++) {
+			size_t pos = begin[k] + i;
+			int32_t s = table[state[k] * numClasses + classOf[(uint8_t)text[pos]]];
+			state[k] = s;
+			if (i + 1 < common) PREFETCH(&table[s * numClasses + classOf[(uint8_t)text[pos + 1]]]);
+			for (int32_t out = s; out >= 0; out = outputLink[out]) {
+				for (int32_t p = finalPattern[out]; p >= 0; p = nextPattern[p]) {
+					matchEntry m;
+					m.pattern = p;
+					m.position = locationOffset + (int64_t)pos + 1 - patternLength[m.pattern];
+					(k == 0 ? result : laneResults[k - 1]).push_back(m);
+				}
+			}
+		}
+	}
+
+	// The lanes may differ in length by a few bytes; finish each one on its own.
+	for (int k = 0; k < numStreams; k++) {
+		vector<matchEntry>& laneResult = (k == 0) ? result : laneResults[k - 1];
+		scanAutomatonFrom(dfa, state[k], text + begin[k] + common, size[k] - common, locationOffset + begin[k] + common, laneResult);
+		if (k > 0) result.insert(result.end(), laneResult.begin(), laneResult.end());
+	}
+}
+
+/**
+* Scan text as numStreams independent lanes advanced in lockstep on the calling thread.
+* A single scan is a chain of dependent table loads, each waiting for the one before; the
+* lanes' loads do not depend on each other, so their cache misses overlap, and the row each
+* lane needs next is prefetched as soon as its state is known. This pays on automata too
+* large for the cache; on small ones scanAutomaton() is as fast. The prefilter is not used
+* in the lockstep part, as the lanes cannot skip independently.
+* Input params:
+* - dfa: Automaton built by compileAutomaton()
+* - text: Input text, does not need to be NULL terminated and may contain NUL bytes
+* - len: Number of bytes to scan
+* - locationOffset: Offset value added to every reported location.
+* - numStreams: Number of lanes, at most MAX_STREAMS.
+* - result: Matches are appended in the same order as by scanAutomaton().
+*/
+void scanInterleaved(const automaton* dfa, const char* text, size_t len, int64_t locationOffset, int numStreams, vector<matchEntry>& result) {
+	if (numStreams > MAX_STREAMS) numStreams = MAX_STREAMS;
+	if (numStreams <= 1 || len < (size_t)numStreams) {
+		scanAutomaton(dfa, text, len, locationOffset, result);
+		return;
+	}
+	if (!dfa->narrowTransitions.empty()) scanLanes(dfa, dfa->narrowTransitions.data(), text, len, locationOffset, numStreams, result);
+	else scanLanes(dfa, dfa->transitions.data(), text, len, locationOffset, numStreams, result);
+}
+
+template <typename stateT>
+static void countLanes(const automaton* dfa, const stateT* table, const char* text, size_t len, int numStreams, int64_t* counts) {
+	const int32_t* finalPattern = dfa->finalPattern.data();
+	const int32_t* nextPattern = dfa->nextPattern.data();
+	const int32_t* outputLink = dfa->outputLink.data();
+	const uint8_t* classOf = dfa->classOf;
+	const size_t numClasses = dfa->numClasses;
+
+	size_t begin[MAX_STREAMS], size[MAX_STREAMS];
+	int32_t state[MAX_STREAMS];
+	size_t common = splitLanes(dfa, text, len, numStreams, begin, size, state);
+
+	for (size_t i = 0; i < common; i++) {
+		for (int k = 0; k < numStreams; k++) {
+			size_t pos = begin[k] + i;
+			int32_t s = table[state[k] * numClasses + classOf[(uint8_t)text[pos]]];
+			state[k] = s;
+			if (i + 1 < common) PREFETCH(&table[s * numClasses + classOf[(uint8_t)text[pos + 1]]]);
+			for (int32_t out = s; out >= 0; out = outputLink[out]) {
+				for (int32_t p = finalPattern[out]; p >= 0; p = nextPattern[p]) {
+					counts[p]++;
+				}
+			}
+		}
+	}
+
+	for (int k = 0; k < numStreams; k++) {
+		countAutomatonFrom(dfa, state[k], text + begin[k] + common, size[k] - common, counts);
+	}
+}
+
+// Count matches per pattern like countAutomaton(), with the lanes of scanInterleaved().
+void countInterleaved(const automaton* dfa, const char* text, size_t len, int numStreams, int64_t* counts) {
+	if (numStreams > MAX_STREAMS) numStreams = MAX_STREAMS;
+	if (numStreams <= 1 || len < (size_t)numStreams) {
+		countAutomaton(dfa, text, len, counts);
+		return;
+	}
+	if (!dfa->narrowTransitions.empty()) countLanes(dfa, dfa->narrowTransitions.data(), text, len, numStreams, counts);
+	else countLanes(dfa, dfa->transitions.data(), text, len, numStreams, counts);
+}
@@ -0,0 +1,133 @@
+// Compiled Aho Corasick automaton. The pointer trie from trie.h is flattened into
+// a dense transition table with the failure links already folded in, so scanning
+// a byte is a single table load with no failure-link walking.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "trie.h"
+#include "flat_array.h"
+#include "prefilter.h"
+
+/**
+* Flat DFA. State 0 is the root.
+* - transitions: numStates x numClasses table; row s holds the next state for every character class.
+*   Empty when narrowTransitions holds the table.
+* - classOf: Maps every input byte to its character class (column in the transition table), see buildClassMap().
+* - outputLink: Nearest state on the failure chain of s with patterns of its own, -1 if none. The matches on
+*   entering s are its own patterns (see nextPattern) followed by those of every state along its output links.
+* - depth: Length of the prefix each state stands for. A transition s -> t is a trie (goto) edge exactly when depth[t] == depth[s] + 1.
+* - patternLength: Length of every pattern, used to turn the end of a match into its start.
+* - finalPattern: Smallest ID of the patterns that end exactly in each state, -1 if none.
+* - nextPattern: Per pattern ID, the next larger ID that ends in the same state, -1 at the end.
+*   finalPattern[s], nextPattern[finalPattern[s]], ... are the patterns ending exactly in s;
+*   as a state stands for one string, they are identical patterns. IDs removed from an
+*   incrementalAutomaton are in no chain.
+* - maxPatternLength: Longest pattern; chunks scanned independently must overlap by maxPatternLength - 1 bytes.
+* - prefilter: Bytes with a transition out of the root, for skipping ahead while in state 0, see initPrefilter().
+* - narrowTransitions: The table with 16-bit state IDs, stored instead of transitions if numStates <=
+*   NARROW_MAX_STATES, see setTransitions(). Only incrementalAutomaton::view() keeps a small table in
+*   transitions, as it grows in place. Readers that are not templated on the width of the state IDs
+*   use transitionOf() and transitionRow().
+*/
+struct automaton {
+	int32_t numStates;
+	int32_t numClasses;
+	int32_t numPatterns;
+	int32_t maxPatternLength;
+	uint8_t classOf[256];
+	flatArray<int32_t> transitions;
+	flatArray<int32_t> outputLink;
+	flatArray<int32_t> depth;
+	flatArray<int32_t> patternLength;
+	flatArray<int32_t> finalPattern;
+	flatArray<int32_t> nextPattern;
+	firstByteFilter prefilter;
+	flatArray<uint16_t> narrowTransitions;
+};
+
+// Most states an automaton can have for its table to fit in 16-bit state IDs.
+const int32_t NARROW_MAX_STATES = 65536;
+
+int32_t buildClassMap(const std::vector<std::string>& patterns, uint8_t classOf[256]);
+
+/**
+* An automaton while compileAutomaton() fills it in.
+* - dfa: The automaton; its scalars and class map are set, its tables not yet.
+* - order: Trie node of every state, in BFS order.
+* - stateOf: State of every trie node.
+* - levelStart: First state of every depth, followed by numStates. States of one depth only
+*   depend on shallower ones, so a level can be compiled in any order.
+* - transitions, outputLink, depth, patternLength, finalPattern: The tables being filled in.
+*/
+struct automatonBuild {
+	automaton* dfa;
+	std::vector<uint32_t> order;
+	std::vector<int32_t> stateOf;
+	std::vector<int32_t> levelStart;
+	std::vector<int32_t> transitions;
+	std::vector<int32_t> outputLink;
+	std::vector<int32_t> depth;
+	std::vector<int32_t> patternLength;
+	std::vector<int32_t> finalPattern;
+};
+
+automaton* compileAutomaton(const trieArena* tree, const std::vector<std::string>& patterns);
+
+void beginAutomaton(const trieArena* tree, const std::vector<std::string>& patterns, automatonBuild& build);
+
+void compileState(const trieArena* tree, automatonBuild& build, int32_t s);
+
+automaton* finishAutomaton(const trieArena* tree, automatonBuild& build);
+
+void initPrefilter(automaton* dfa);
+
+void setTransitions(automaton* dfa, std::vector<int32_t>& table);
+
+void transitionRow(const automaton* dfa, int32_t state, int32_t* row);
+
+// Next state from state on character class c, from whichever table dfa stores.
+inline int32_t transitionOf(const automaton* dfa, int32_t state, int32_t c) {
+	size_t i = (size_t)state * dfa->numClasses + c;
+	return dfa->narrowTransitions.empty() ? dfa->transitions[i] : (int32_t)dfa->narrowTransitions[i];
+}
+
+/**
+* Scanner state for input that arrives in blocks, e.g. from a socket or a growing log.
+* Blocks are scanned in order as if they were one text, so matches spanning block
+* boundaries are found without rescanning any overlap, and positions are stream offsets.
+* - state: DFA state after the last byte scanned.
+* - offset: Number of bytes scanned so far, i.e. the stream offset of the next block.
+*/
+struct scanStream {
+	const automaton* dfa;
+	int32_t state;
+	int64_t offset;
+};
+
+int32_t scanAutomatonFrom(const automaton* dfa, int32_t state, const char* text, size_t len, int64_t locationOffset, std::vector<matchEntry>& result);
+
+void scanAutomaton(const automaton* dfa, const char* text, size_t len, int64_t locationOffset, std::vector<matchEntry>& result);
+
+void streamInit(scanStream* stream, const automaton* dfa);
+
+void streamScan(scanStream* stream, const char* block, size_t len, std::vector<matchEntry>& result);
+
+int32_t advanceAutomaton(const automaton* dfa, int32_t state, const char* text, size_t len);
+
+int32_t countAutomatonFrom(const automaton* dfa, int32_t state, const char* text, size_t len, int64_t* counts);
+
+void countAutomaton(const automaton* dfa, const char* text, size_t len, int64_t* counts);
+
+void streamCount(scanStream* stream, const char* block, size_t len, int64_t* counts);
+
+// Most lanes the interleaved scanners advance at once.
+const int MAX_STREAMS = 16;
+
+void scanInterleaved(const automaton* dfa, const char* text, size_t len, int64_t locationOffset, int numStreams, std::vector<matchEntry>& result);
+
+void countInterleaved(const automaton* dfa, const char* text, size_t len, int numStreams, int64_t* counts);
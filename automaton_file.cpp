@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "automaton_file.h"
+
+using namespace std;
+
+// Place a section of count elements of elementSize bytes at the next aligned offset.
+static void placeSection(automatonFileHeader& header, automatonFileSectionId id, size_t count, size_t elementSize, uint64_t& offset) {
+	offset = (offset + AUTOMATON_FILE_ALIGNMENT - 1) / AUTOMATON_FILE_ALIGNMENT * AUTOMATON_FILE_ALIGNMENT;
+	header.sections[id].offset = offset;
+	header.sections[id].count = count;
+	offset += count * elementSize;
+}
+
+// Pad with zero bytes up to the section's offset, then write its elements.
+template <typename T>
+static bool writeSection(FILE* fp, const automatonFileSection& section, const flatArray<T>& elements, uint64_t& written) {
+	static const char padding[AUTOMATON_FILE_ALIGNMENT] = { 0 };
+	if (fwrite(padding, 1, (size_t)(section.offset - written), fp) != section.offset - written) return false;
+	if (!elements.empty() && fwrite(elements.data(), sizeof(T), elements.size(), fp) != elements.size()) return false;
+	written = section.offset + elements.size() * sizeof(T);
+	return true;
+}
+
+/**
+* Write an automaton and its PFAC tables. The layout is fixed before anything is written,
+* so fp may be a pipe.
+* Input params:
+* - fp: File opened for binary writing
+* - dfa: Automaton built by compileAutomaton()
+* - table: Tables built from dfa by buildPfacTable()
+* Returns false if writing fails.
+*/
+bool saveAutomaton(FILE* fp, const automaton* dfa, const pfacTable& table) {
+	automatonFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, AUTOMATON_FILE_MAGIC, sizeof(header.magic));
+	header.version = AUTOMATON_FILE_VERSION;
+	header.byteOrder = AUTOMATON_FILE_BYTE_ORDER;
+	header.numStates = dfa->numStates;
+	header.numClasses = dfa->numClasses;
+	header.numPatterns = dfa->numPatterns;
+	header.maxPatternLength = dfa->maxPatternLength;
+	header.pfacInitialState = table.initialState;
+	header.pfacNumStates = table.numStates;
+	memcpy(header.classOf, dfa->classOf, sizeof(header.classOf));
+	memcpy(header.initialTransitions, table.initialTransitions, sizeof(header.initialTransitions));
+
+	// The int32_t sections; the narrow table comes last. One of the two tables is empty.
+	const flatArray<int32_t>* arrays[SECTION_NARROW_TRANSITIONS] = { &dfa->transitions, &dfa->outputLink,
+		&dfa->depth, &dfa->patternLength, &dfa->finalPattern, &dfa->nextPattern, &table.hashRow, &table.hashVal };
+	uint64_t offset = sizeof(header);
+	for (int id = 0; id < SECTION_NARROW_TRANSITIONS; id++) {
+		placeSection(header, (automatonFileSectionId)id, arrays[id]->size(), sizeof(int32_t), offset);
+	}
+	placeSection(header, SECTION_NARROW_TRANSITIONS, dfa->narrowTransitions.size(), sizeof(uint16_t), offset);
+	header.fileSize = offset;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1) return false;
+	uint64_t written = sizeof(header);
+	for (int id = 0; id < SECTION_NARROW_TRANSITIONS; id++) {
+		if (!writeSection(fp, header.sections[id], *arrays[id], written)) return false;
+	}
+	if (!writeSection(fp, header.sections[SECTION_NARROW_TRANSITIONS], dfa->narrowTransitions, written)) return false;
+	return fflush(fp) == 0;
+}
+
+/**
+* Map a file written by saveAutomaton() and point dfa and table at its sections.
+* Only the header is checked: magic, version, byte order, and that every section lies
+* inside the file with the element count the scalars call for. The arrays themselves are
+* trusted, as they come from the compile step.
+* Input params:
+* - fileName: Automaton file
+* - file: Receives the mapping. dfa and table use it until it is released with unmapFile().
+* - dfa, table: Receive the automaton and its PFAC tables.
+* Returns false, after printing the reason, if the file cannot be mapped or is not a valid automaton file.
+*/
+bool loadAutomaton(const char* fileName, mappedFile* file, automaton* dfa, pfacTable& table) {
+	if (!mapFile(fileName, file, false, false)) return false;
+
+	const automatonFileHeader* header = (const automatonFileHeader*)file->data;
+	const char* problem = NULL;
+	if (file->size < sizeof(automatonFileHeader) || memcmp(header->magic, AUTOMATON_FILE_MAGIC, sizeof(header->magic)) != 0) {
+		problem = "not an automaton file";
+	}
+	else if (header->version != AUTOMATON_FILE_VERSION) {
+		problem = "unsupported format version";
+	}
+	else if (header->byteOrder != AUTOMATON_FILE_BYTE_ORDER) {
+		problem = "written on a machine of the other byte order";
+	}
+	else if (header->fileSize != file->size) {
+		problem = "truncated file";
+	}
+
+	uint64_t expectedCount[NUM_SECTIONS];
+	if (NULL == problem) {
+		// The table is stored at one width only, the narrow one only if the state IDs fit.
+		uint64_t tableCount = (uint64_t)header->numStates * header->numClasses;
+		bool hasNarrow = header->sections[SECTION_NARROW_TRANSITIONS].count > 0 && header->numStates <= NARROW_MAX_STATES;
+		expectedCount[SECTION_TRANSITIONS] = hasNarrow ? 0 : tableCount;
+		expectedCount[SECTION_OUTPUT_LINK] = header->numStates;
+		expectedCount[SECTION_DEPTH] = header->numStates;
+		expectedCount[SECTION_PATTERN_LENGTH] = header->numPatterns;
+		expectedCount[SECTION_FINAL_PATTERN] = header->numStates;
+		expectedCount[SECTION_NEXT_PATTERN] = header->numPatterns;
+		expectedCount[SECTION_HASH_ROW] = 2 * (uint64_t)header->pfacNumStates;
+		expectedCount[SECTION_HASH_VAL] = header->sections[SECTION_HASH_VAL].count;
+		expectedCount[SECTION_NARROW_TRANSITIONS] = hasNarrow ? tableCount : 0;
+		for (int id = 0; id < NUM_SECTIONS && NULL == problem; id++) {
+			const automatonFileSection& section = header->sections[id];
+			size_t elementSize = (id == SECTION_NARROW_TRANSITIONS) ? sizeof(uint16_t) : sizeof(int32_t);
+			if (section.count != expectedCount[id] || section.offset % elementSize != 0 ||
+				section.offset > file->size || section.count > (file->size - section.offset) / elementSize) {
+				problem = "corrupt section table";
+			}
+		}
+	}
+	if (NULL != problem) {
+		printf("Error: Failed to load automaton file '%s': %s\n", fileName, problem);
+		unmapFile(file);
+		return false;
+	}
+
+	dfa->numStates = header->numStates;
+	dfa->numClasses = header->numClasses;
+	dfa->numPatterns = header->numPatterns;
+	dfa->maxPatternLength = header->maxPatternLength;
+	memcpy(dfa->classOf, header->classOf, sizeof(dfa->classOf));
+	table.initialState = header->pfacInitialState;
+	table.numStates = header->pfacNumStates;
+	table.maxPatternLength = header->maxPatternLength;
+	memcpy(table.initialTransitions, header->initialTransitions, sizeof(table.initialTransitions));
+
+	flatArray<int32_t>* arrays[SECTION_NARROW_TRANSITIONS] = { &dfa->transitions, &dfa->outputLink,
+		&dfa->depth, &dfa->patternLength, &dfa->finalPattern, &dfa->nextPattern, &table.hashRow, &table.hashVal };
+	for (int id = 0; id < SECTION_NARROW_TRANSITIONS; id++) {
+		arrays[id]->attach((const int32_t*)(file->data + header->sections[id].offset), (size_t)header->sections[id].count);
+	}
+	const automatonFileSection& narrow = header->sections[SECTION_NARROW_TRANSITIONS];
+	dfa->narrowTransitions.attach((const uint16_t*)(file->data + narrow.offset), (size_t)narrow.count);
+	initPrefilter(dfa);
+	return true;
+}
@@ -0,0 +1,70 @@
+// Versioned binary file holding a compiled automaton and its PFAC tables. The file is
+// written once by the compile step and memory-mapped at startup; the arrays are used
+// in place, so loading costs a few header checks regardless of the automaton size.
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "automaton.h"
+#include "pfac_table.h"
+#include "mapped_file.h"
+
+// "PFACDFA" plus a terminating NUL.
+const char AUTOMATON_FILE_MAGIC[8] = { 'P', 'F', 'A', 'C', 'D', 'F', 'A', '\0' };
+
+// Bump whenever the header or the layout of any section changes.
+const uint32_t AUTOMATON_FILE_VERSION = 5;
+
+// Written as a native integer; reads back differently on a machine of the other byte order.
+const uint32_t AUTOMATON_FILE_BYTE_ORDER = 0x01020304;
+
+// Sections start on cache line boundaries.
+const uint64_t AUTOMATON_FILE_ALIGNMENT = 64;
+
+// Sections, in file order. Every section is an int32_t array, except SECTION_NARROW_TRANSITIONS,
+// which holds uint16_t. Exactly one of SECTION_TRANSITIONS and SECTION_NARROW_TRANSITIONS holds
+// the transition table, whichever the automaton stores; the other one is empty.
+enum automatonFileSectionId {
+	SECTION_TRANSITIONS,
+	SECTION_OUTPUT_LINK,
+	SECTION_DEPTH,
+	SECTION_PATTERN_LENGTH,
+	SECTION_FINAL_PATTERN,
+	SECTION_NEXT_PATTERN,
+	SECTION_HASH_ROW,
+	SECTION_HASH_VAL,
+	SECTION_NARROW_TRANSITIONS,
+	NUM_SECTIONS
+};
+
+// offset: Byte offset of the section from the start of the file. count: Number of elements.
+struct automatonFileSection {
+	uint64_t offset;
+	uint64_t count;
+};
+
+/**
+* File header, followed by the sections. Scalars are those of automaton and pfacTable;
+* the sections hold their arrays. Everything is stored in native byte order and layout.
+*/
+struct automatonFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t fileSize;
+	int32_t numStates;
+	int32_t numClasses;
+	int32_t numPatterns;
+	int32_t maxPatternLength;
+	int32_t pfacInitialState;
+	int32_t pfacNumStates;
+	uint8_t classOf[256];
+	int32_t initialTransitions[256];
+	automatonFileSection sections[NUM_SECTIONS];
+};
+
+bool saveAutomaton(FILE* fp, const automaton* dfa, const pfacTable& table);
+
+bool loadAutomaton(const char* fileName, mappedFile* file, automaton* dfa, pfacTable& table);
@@ -0,0 +1,171 @@
+#include <string.h>
+#include <algorithm>
+
+#include "automaton_minimize.h"
+
+using namespace std;
+
+// Bytes of the transition tables of dfa.
+static size_t tableBytes(const automaton* dfa) {
+	return dfa->transitions.size() * sizeof(int32_t) + dfa->narrowTransitions.size() * sizeof(uint16_t);
+}
+
+// Hash of the block of a state and the blocks its row leads to.
+template <typename stateT>
+static uint64_t rowHash(const stateT* row, size_t numClasses, const int32_t* block, int32_t s) {
+	const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+	uint64_t h = (uint64_t)block[s] * multiplier;
+	for (size_t c = 0; c < numClasses; c++) {
+		h = (h ^ (uint32_t)block[row[c]]) * multiplier;
+	}
+	return h;
+}
+
+// States s and t are in one block and lead to one block on every class.
+template <typename stateT>
+static bool sameRow(const stateT* table, size_t numClasses, const int32_t* block, int32_t s, int32_t t) {
+	if (block[s] != block[t]) return false;
+	const stateT* rowS = &table[(size_t)s * numClasses];
+	const stateT* rowT = &table[(size_t)t * numClasses];
+	for (size_t c = 0; c < numClasses; c++) {
+		if (block[rowS[c]] != block[rowT[c]]) return false;
+	}
+	return true;
+}
+
+/**
+* One refinement round: split every block by the blocks its states lead to.
+* Input params:
+* - dfa: Automaton being minimized
+* - table: Transition table of dfa, of either width of state IDs
+* - block: Current block of every state
+* - slots: Hash table of a power of two size at least twice the number of states
+* - next: Receives the new block of every state, numbered in order of their first state.
+* Returns the number of blocks in next.
+*/
+template <typename stateT>
+static int32_t refine(const automaton* dfa, const stateT* table, const vector<int32_t>& block, vector<int32_t>& slots,
+	vector<int32_t>& next) {
+	const size_t numClasses = dfa->numClasses;
+	const size_t mask = slots.size() - 1;
+	int shift = 64;
+	for (size_t size = slots.size(); size > 1; size /= 2) shift--;
+
+	fill(slots.begin(), slots.end(), -1);
+	int32_t numBlocks = 0;
+	for (int32_t s = 0; s < dfa->numStates; s++) {
+		// The top bits are the best mixed ones of a multiplicative hash.
+		size_t i = (size_t)(rowHash(&table[(size_t)s * numClasses], numClasses, block.data(), s) >> shift);
+		while (slots[i] >= 0 && !sameRow(table, numClasses, block.data(), slots[i], s)) i = (i + 1) & mask;
+		if (slots[i] < 0) {
+			slots[i] = s;
+			next[s] = numBlocks++;
+		}
+		else {
+			next[s] = next[slots[i]];
+		}
+	}
+	return numBlocks;
+}
+
+automaton* minimizeAutomaton(const automaton* dfa, minimizeReport* report) {
+	const int32_t numStates = dfa->numStates;
+	const size_t numClasses = dfa->numClasses;
+
+	// Initial blocks: one per nearest state with patterns, plus one for the states without matches.
+	vector<int32_t> block(numStates);
+	int32_t numBlocks = 0;
+	bool anySilent = false;
+	for (int32_t s = 0; s < numStates; s++) {
+		bool ownPatterns = dfa->finalPattern[s] >= 0;
+		int32_t nearest = ownPatterns ? s : dfa->outputLink[s];
+		block[s] = nearest + 1;
+		if (ownPatterns) numBlocks++;
+		if (nearest < 0) anySilent = true;
+	}
+	if (anySilent) numBlocks++;
+
+	// Refinement only ever splits blocks, so the partition is stable once the count stays the same.
+	size_t numSlots = 2;
+	while (numSlots < 2 * (size_t)numStates) numSlots *= 2;
+	vector<int32_t> slots(numSlots);
+	vector<int32_t> next(numStates);
+	int rounds = 0;
+	for (;;) {
+		int32_t refined = dfa->narrowTransitions.empty() ? refine(dfa, dfa->transitions.data(), block, slots, next)
+			: refine(dfa, dfa->narrowTransitions.data(), block, slots, next);
+		rounds++;
+		block.swap(next);
+		if (refined == numBlocks) break;
+		numBlocks = refined;
+	}
+	vector<int32_t>().swap(slots);
+	vector<int32_t>().swap(next);
+
+	// Every block is represented by its shallowest state. A block with a state that has
+	// patterns holds no shallower state, as the others reach it through their failure links.
+	vector<int32_t> representative(numBlocks, -1);
+	for (int32_t s = 0; s < numStates; s++) {
+		int32_t& r = representative[block[s]];
+		if (r < 0 || dfa->depth[s] < dfa->depth[r]) r = s;
+	}
+
+	// Number the blocks in BFS order from the root's.
+	vector<int32_t> stateOf(numBlocks, -1);
+	vector<int32_t> order;
+	vector<int32_t> row(numClasses);
+	order.reserve(numBlocks);
+	stateOf[block[0]] = 0;
+	order.push_back(block[0]);
+	for (size_t k = 0; k < order.size(); k++) {
+		transitionRow(dfa, representative[order[k]], row.data());
+		for (size_t c = 0; c < numClasses; c++) {
+			int32_t b = block[row[c]];
+			if (stateOf[b] < 0) {
+				stateOf[b] = order.size();
+				order.push_back(b);
+			}
+		}
+	}
+
+	automaton* result = new automaton();
+	result->numStates = order.size();
+	result->numClasses = dfa->numClasses;
+	result->numPatterns = dfa->numPatterns;
+	result->maxPatternLength = dfa->maxPatternLength;
+	memcpy(result->classOf, dfa->classOf, sizeof(result->classOf));
+
+	vector<int32_t> transitions((size_t)result->numStates * numClasses);
+	vector<int32_t> outputLink(result->numStates);
+	vector<int32_t> depth(result->numStates);
+	vector<int32_t> finalPattern(result->numStates);
+	for (int32_t k = 0; k < result->numStates; k++) {
+		int32_t s = representative[order[k]];
+		transitionRow(dfa, s, row.data());
+		int32_t* newRow = &transitions[(size_t)k * numClasses];
+		for (size_t c = 0; c < numClasses; c++) newRow[c] = stateOf[block[row[c]]];
+		outputLink[k] = (dfa->outputLink[s] < 0) ? -1 : stateOf[block[dfa->outputLink[s]]];
+		depth[k] = dfa->depth[s];
+		finalPattern[k] = dfa->finalPattern[s];
+	}
+	// Every block keeps the patterns of its representative, so the chains stay as they are.
+	vector<int32_t> patternLength(dfa->patternLength.begin(), dfa->patternLength.end());
+	vector<int32_t> nextPattern(dfa->nextPattern.begin(), dfa->nextPattern.end());
+
+	setTransitions(result, transitions);
+	result->outputLink.assign(outputLink);
+	result->depth.assign(depth);
+	result->patternLength.assign(patternLength);
+	result->finalPattern.assign(finalPattern);
+	result->nextPattern.assign(nextPattern);
+	initPrefilter(result);
+
+	if (report) {
+		report->statesBefore = numStates;
+		report->statesAfter = result->numStates;
+		report->tableBytesBefore = tableBytes(dfa);
+		report->tableBytesAfter = tableBytes(result);
+		report->rounds = rounds;
+	}
+	return result;
+}
@@ -0,0 +1,55 @@
+// Tombstone compaction by state minimization. Removing patterns from an incrementalAutomaton
+// leaves their trie paths behind as states that behave exactly like their failure states;
+// merging them shrinks the table of a snapshot() back towards that of a rebuild, so more of
+// it stays in the cache and automaton files get smaller.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "automaton.h"
+
+/**
+* Sizes before and after minimizeAutomaton().
+* - statesBefore, statesAfter: Number of states.
+* - tableBytesBefore, tableBytesAfter: Bytes of the transition table, at the width it is stored in.
+* - rounds: Refinement rounds until the partition was stable.
+*/
+struct minimizeReport {
+	int32_t statesBefore;
+	int32_t statesAfter;
+	size_t tableBytesBefore;
+	size_t tableBytesAfter;
+	int rounds;
+};
+
+/**
+* Merge the states of dfa that report the same matches on every input. The result scans
+* exactly like dfa: same matches, in the same order.
+*
+* The states start out grouped by the matches they report on being entered. As every
+* pattern belongs to one state only, two states report the same matches exactly when they
+* have the same nearest state with patterns: the state itself if it has patterns, its
+* output link otherwise. The partition is then refined (Moore's algorithm) by splitting
+* every block whose states lead to different blocks on some class, until no block splits.
+* Each round hashes every row once, so the cost is rounds x numStates x numClasses; rounds
+* stay close to the longest pattern.
+*
+* This is meant for incrementalAutomaton::snapshot() after removals, where every state left
+* with no pattern at or below it merges into the state it behaves like. An automaton compiled
+* from a pattern list is minimal already, so there it costs the refinement and merges nothing:
+* every state is a prefix of some pattern, and of two different prefixes, the longer one
+* completes a pattern the other cannot.
+*
+* A block keeps the patterns, output link, depth and final pattern of its shallowest state.
+* The result is no trie any more: transitions that increase depth need not be trie edges,
+* so buildPfacTable() and the longest-match path of the PFAC API need dfa itself. The
+* PFAC tables built from dfa can be saved together with the result.
+* States are numbered in BFS order from the root, which stays state 0.
+* Input params:
+* - dfa: Automaton from incrementalAutomaton::snapshot(), compileAutomaton() or a file
+* - report: Receives the reduction; may be NULL.
+* Returns a new automaton that owns its tables.
+*/
+automaton* minimizeAutomaton(const automaton* dfa, minimizeReport* report);
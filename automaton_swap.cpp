@@ -0,0 +1,153 @@
+#include "automaton_swap.h"
+
+using namespace std;
+
+// Slot value of a reader outside enter()/exit().
+const uint64_t IDLE = UINT64_MAX;
+
+automatonSwap::automatonSwap(automaton* initial, int maxReaders)
+	: current(initial), globalEpoch(1), maxReaders(maxReaders > 0 ? maxReaders : 1), numReaders(0) {
+	slots = new readerSlot[this->maxReaders];
+	for (int i = 0; i < this->maxReaders; i++) slots[i].epoch.store(IDLE);
+}
+
+automatonSwap::~automatonSwap() {
+	waitRebuild();
+	for (size_t i = 0; i < retired.size(); i++) delete retired[i].dfa;
+	delete current.load();
+	delete[] slots;
+}
+
+/**
+* Claim a reader slot for the calling thread. A slot must only be used by one thread at a time.
+* Slots given back by removeReader() are handed out again first.
+* Returns the slot to pass to enter() and exit(), or -1 if all maxReaders slots are taken.
+*/
+int automatonSwap::addReader() {
+	lock_guard<mutex> guard(readerLock);
+	if (!freeReaders.empty()) {
+		int reader = freeReaders.back();
+		freeReaders.pop_back();
+		return reader;
+	}
+	int reader = numReaders.load();
+	if (reader >= maxReaders) return -1;
+	numReaders.store(reader + 1);
+	return reader;
+}
+
+/**
+* Give back a slot claimed by addReader(), outside enter()/exit(). The slot stays idle,
+* so it holds back no reclamation until addReader() hands it out again.
+*/
+void automatonSwap::removeReader(int reader) {
+	slots[reader].epoch.store(IDLE);
+	lock_guard<mutex> guard(readerLock);
+	freeReaders.push_back(reader);
+}
+
+/**
+* Start a scan: returns the current automaton, which is not freed before exit(reader).
+* Calls on one slot must not nest.
+*/
+const automaton* automatonSwap::enter(int reader) {
+	// The epoch must be visible to reclaim() before the automaton is read, hence sequentially consistent.
+	slots[reader].epoch.store(globalEpoch.load());
+	return current.load();
+}
+
+// End the scan started by enter(reader).
+void automatonSwap::exit(int reader) {
+	slots[reader].epoch.store(IDLE, memory_order_release);
+}
+
+/**
+* Make dfa the automaton of every later enter() and retire the previous one, which is freed
+* as soon as the readers using it have left. Takes ownership of dfa, which must own its
+* tables, i.e. come from compileAutomaton() rather than a mapped automaton file.
+*/
+void automatonSwap::publish(automaton* dfa) {
+	lock_guard<mutex> guard(writerLock);
+	automaton* old = current.exchange(dfa);
+	uint64_t epoch = globalEpoch.fetch_add(1) + 1;
+	if (old) {
+		retiredAutomaton r = { old, epoch };
+		retired.push_back(r);
+	}
+	reclaimLocked();
+}
+
+/**
+* Free the retired automata no reader can hold any more. publish() does this too; call it
+* to release memory sooner when publishing is rare and scans are long.
+* Returns the number of automata freed.
+*/
+size_t automatonSwap::reclaim() {
+	lock_guard<mutex> guard(writerLock);
+	return reclaimLocked();
+}
+
+size_t automatonSwap::reclaimLocked() {
+	// Readers that entered before the latest swap hold an epoch below it; an automaton retired
+	// at epoch e is safe once no reader is left with an epoch below e.
+	uint64_t oldest = IDLE;
+	int count = numReaders.load();
+	for (int i = 0; i < count; i++) {
+		uint64_t epoch = slots[i].epoch.load();
+		if (epoch < oldest) oldest = epoch;
+	}
+	size_t kept = 0;
+	size_t freed = 0;
+	for (size_t i = 0; i < retired.size(); i++) {
+		if (retired[i].epoch <= oldest) {
+			delete retired[i].dfa;
+			freed++;
+		}
+		else {
+			retired[kept++] = retired[i];
+		}
+	}
+	retired.resize(kept);
+	return freed;
+}
+
+/**
+* Compile a pattern set on the calling thread and publish it. Pattern IDs are the indices in
+* patterns, as for compileAutomaton().
+* Returns false, leaving the current automaton in place, if memory runs out.
+*/
+bool automatonSwap::rebuild(const vector<string>& patterns) {
+	trieArena* tree = NULL;
+	automaton* dfa = NULL;
+	try {
+		tree = trie(patterns);
+		defineFailures(tree);
+		dfa = compileAutomaton(tree, patterns);
+	}
+	catch (const bad_alloc&) {
+		deleteTrie(tree);
+		return false;
+	}
+	deleteTrie(tree);
+	publish(dfa);
+	return true;
+}
+
+/**
+* Compile and publish a pattern set on a background thread, see rebuild(). Readers keep
+* scanning with the current automaton meanwhile. A rebuild still running is waited for
+* first, so rebuilds are published in the order they were requested.
+*/
+void automatonSwap::rebuildAsync(const vector<string>& patterns) {
+	waitRebuild();
+	builder = thread([this, patterns] { rebuild(patterns); });
+}
+
+void automatonSwap::waitRebuild() {
+	if (builder.joinable()) builder.join();
+}
+
+size_t automatonSwap::retiredCount() {
+	lock_guard<mutex> guard(writerLock);
+	return retired.size();
+}
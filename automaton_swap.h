@@ -0,0 +1,84 @@
+// Replacing the automaton of a running scanner. A new pattern set is compiled in the
+// background and published with one atomic store; scans in flight finish on the automaton
+// they started with and later scans use the new one. Readers take no lock: an old
+// automaton is freed by epoch-based reclamation once no reader can still hold it.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "automaton.h"
+
+/**
+* The current automaton of a set of scanner threads.
+* Every reader thread claims a slot with addReader() and brackets each scan with enter()
+* and exit(); the automaton returned by enter() stays valid until the matching exit().
+* A thread that stops scanning gives its slot back with removeReader() for the next addReader().
+* enter() costs one store and one load of a shared pointer, exit() one store.
+*
+* Reclamation: publish() swaps the automaton and advances a global epoch. enter() records
+* the epoch it saw in the reader's slot before it loads the automaton, so a reader whose
+* slot shows an epoch after the swap cannot hold the old automaton. The old one is freed
+* once every slot is idle or shows such an epoch; until then it waits in a retired list,
+* which publish() and reclaim() sweep.
+*/
+class automatonSwap {
+public:
+	// initial may be NULL, in which case enter() returns NULL until something is published.
+	automatonSwap(automaton* initial, int maxReaders);
+	// Waits for a background rebuild and frees every automaton. No reader may be inside enter()/exit().
+	~automatonSwap();
+
+	int addReader();
+
+	void removeReader(int reader);
+
+	const automaton* enter(int reader);
+
+	void exit(int reader);
+
+	void publish(automaton* dfa);
+
+	size_t reclaim();
+
+	bool rebuild(const std::vector<std::string>& patterns);
+
+	void rebuildAsync(const std::vector<std::string>& patterns);
+
+	// Wait for the rebuild started by rebuildAsync(), if any.
+	void waitRebuild();
+
+	// Number of published automata not freed yet, the current one excluded.
+	size_t retiredCount();
+
+private:
+	// One reader's epoch, IDLE outside enter()/exit(). Padded so readers do not share cache lines.
+	struct readerSlot {
+		std::atomic<uint64_t> epoch;
+		char padding[64 - sizeof(std::atomic<uint64_t>)];
+	};
+
+	// An automaton replaced when the global epoch advanced to epoch.
+	struct retiredAutomaton {
+		automaton* dfa;
+		uint64_t epoch;
+	};
+
+	size_t reclaimLocked();
+
+	std::atomic<automaton*> current;
+	std::atomic<uint64_t> globalEpoch;
+	readerSlot* slots;
+	int maxReaders;
+	std::atomic<int> numReaders;
+	std::mutex readerLock;
+	std::vector<int> freeReaders;
+	std::mutex writerLock;
+	std::vector<retiredAutomaton> retired;
+	std::thread builder;
+};
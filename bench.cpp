@@ -0,0 +1,515 @@
+// Throughput benchmark for the scanner engines: the reference trie (scanText), the compiled
+// DFA, the DFA on a thread pool, the count-only DFA, the interleaved DFA, a batch of records,
+// and the OpenCL PFAC kernel, in one launch and pipelined in chunks.
+// Corpora and pattern sets are either generated with a controlled alphabet, size and match
+// density or read from files. Results are printed as one JSON object per line.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+#include "trie.h"
+#include "automaton.h"
+#include "automaton_minimize.h"
+#include "incremental_automaton.h"
+#include "parallel_scan.h"
+#include "parallel_build.h"
+#include "prefilter.h"
+#include "pfac_table.h"
+#include "mapped_file.h"
+#ifndef PFAC_NO_OPENCL
+#include "pfac_ocl.h"
+#else
+// Built without OpenCL: the pfac engine is skipped.
+struct pfacDevice;
+#endif
+
+using namespace std;
+
+// Results go here, one JSON object per line. The library prints its diagnostics to stdout,
+// so --output keeps them out of the results.
+FILE* resultFile = stdout;
+
+/**
+* Benchmark settings, see usage().
+* - patternCounts: Generated pattern set sizes; one benchmark round per size.
+* - alphabetSize: Number of distinct bytes in the generated corpus and patterns.
+* - corpusSize: Generated corpus size in bytes.
+* - density: Planted matches per KiB of generated corpus.
+* - minPatternLength, maxPatternLength: Length range of generated patterns.
+* - repetitions: Timed runs per engine; the percentiles are taken over these.
+* - threads: Thread pool size, 0 for one thread per core.
+* - streams: Lanes of the interleaved engine.
+* - recordSize: Bytes per record of the records engine, which scans the corpus as a batch of records.
+* - chunkSize: Bytes per chunk of the pipelined engine, 0 for PFAC_PIPELINE_CHUNK_SIZE.
+* - seed: Seed of the generator, so runs are repeatable.
+* - corpusFile, patternFile: Real data to use instead of generated data.
+* - engines: Comma separated engines to run.
+* - kernelFile: PFAC.cl, for the pfac engine.
+* - prefilter: Prefilter variant to use instead of the one chosen for the CPU, or NULL.
+* - outputFile: File for the results, or NULL for stdout.
+*/
+struct benchConfig {
+	vector<int> patternCounts;
+	int alphabetSize;
+	size_t corpusSize;
+	double density;
+	int minPatternLength;
+	int maxPatternLength;
+	int repetitions;
+	int threads;
+	int streams;
+	size_t recordSize;
+	size_t chunkSize;
+	unsigned seed;
+	const char* corpusFile;
+	const char* patternFile;
+	string engines;
+	const char* kernelFile;
+	const char* prefilter;
+	const char* outputFile;
+};
+
+/**
+* Timings of one measured operation.
+* - seconds: Duration of every repetition, sorted once all are taken.
+*/
+struct benchTimes {
+	vector<double> seconds;
+};
+
+static double now() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Run op repetitions times and record the duration of each run.
+static benchTimes timeRuns(int repetitions, const function<void()>& op) {
+	benchTimes times;
+	for (int r = 0; r < repetitions; r++) {
+		double start = now();
+		op();
+		times.seconds.push_back(now() - start);
+	}
+	sort(times.seconds.begin(), times.seconds.end());
+	return times;
+}
+
+// Nearest rank percentile of sorted durations.
+static double percentile(const benchTimes& times, double p) {
+	if (times.seconds.empty()) return 0;
+	size_t rank = (size_t)(p / 100.0 * times.seconds.size() + 0.999999);
+	if (rank < 1) rank = 1;
+	if (rank > times.seconds.size()) rank = times.seconds.size();
+	return times.seconds[rank - 1];
+}
+
+// Print the duration percentiles as JSON members, in milliseconds.
+static void printTimes(const char* name, const benchTimes& times) {
+	fprintf(resultFile, "\"%s_ms\":{\"min\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f}", name,
+		1e3 * percentile(times, 0), 1e3 * percentile(times, 50), 1e3 * percentile(times, 90),
+		1e3 * percentile(times, 99), 1e3 * percentile(times, 100));
+}
+
+/**
+* Generate patterns over the first alphabetSize bytes of 'a'...
+* Duplicates are dropped, so the set may hold a few less than numPatterns patterns.
+*/
+static vector<string> generatePatterns(const benchConfig& config, int numPatterns, mt19937& rng) {
+	vector<string> patterns;
+	uniform_int_distribution<int> length(config.minPatternLength, config.maxPatternLength);
+	uniform_int_distribution<int> symbol(0, config.alphabetSize - 1);
+	for (int i = 0; i < numPatterns; i++) {
+		string pattern;
+		int len = length(rng);
+		for (int j = 0; j < len; j++) pattern += (char)('a' + symbol(rng));
+		patterns.push_back(pattern);
+	}
+	sort(patterns.begin(), patterns.end());
+	patterns.erase(unique(patterns.begin(), patterns.end()), patterns.end());
+	shuffle(patterns.begin(), patterns.end(), rng);
+	return patterns;
+}
+
+/**
+* Generate corpusSize random bytes over the alphabet, then copy randomly chosen patterns to
+* random positions until the planted matches reach density per KiB. Random text adds
+* matches of its own for short patterns and small alphabets; the benchmark reports the
+* matches it actually finds.
+*/
+static string generateCorpus(const benchConfig& config, const vector<string>& patterns, mt19937& rng) {
+	string corpus(config.corpusSize, 'a');
+	uniform_int_distribution<int> symbol(0, config.alphabetSize - 1);
+	for (size_t i = 0; i < corpus.size(); i++) corpus[i] = (char)('a' + symbol(rng));
+	if (patterns.empty() || corpus.empty()) return corpus;
+
+	size_t planted = (size_t)(config.density * corpus.size() / 1024);
+	uniform_int_distribution<size_t> which(0, patterns.size() - 1);
+	uniform_int_distribution<size_t> where(0, corpus.size() - 1);
+	for (size_t k = 0; k < planted; k++) {
+		const string& pattern = patterns[which(rng)];
+		size_t position = where(rng);
+		if (pattern.length() > corpus.size() - position) continue;
+		memcpy(&corpus[position], pattern.data(), pattern.length());
+	}
+	return corpus;
+}
+
+// Read one pattern per line, skipping empty lines, as PFAC_readPatternFromFile() does.
+static bool readPatterns(const char* fileName, vector<string>& patterns) {
+	ifstream input(fileName, ifstream::in | ifstream::binary);
+	if (!input.is_open()) {
+		printf("Error: Failed to open pattern file '%s'\n", fileName);
+		return false;
+	}
+	string buffer;
+	while (getline(input, buffer)) {
+		if (!buffer.empty() && buffer[buffer.size() - 1] == '\r') buffer.erase(buffer.size() - 1);
+		if (!buffer.empty()) patterns.push_back(buffer);
+	}
+	return true;
+}
+
+static bool engineEnabled(const benchConfig& config, const char* engine) {
+	string list = "," + config.engines + ",";
+	return list.find(string(",") + engine + ",") != string::npos;
+}
+
+/**
+* Print the result line of one engine.
+* Input params:
+* - engine: Engine name
+* - numPatterns: Size of the pattern set
+* - corpusSize: Bytes scanned per run
+* - matches: Matches found by one run
+* - times: Scan durations; GB/s and matches/s are taken from the median
+*/
+static void printResult(const char* engine, size_t numPatterns, size_t corpusSize, size_t matches, const benchTimes& times) {
+	double median = percentile(times, 50);
+	fprintf(resultFile, "{\"kind\":\"scan\",\"engine\":\"%s\",\"patterns\":%zu,\"bytes\":%zu,\"matches\":%zu,\"runs\":%zu,",
+		engine, numPatterns, corpusSize, matches, times.seconds.size());
+	fprintf(resultFile, "\"gb_per_s\":%.4f,\"matches_per_s\":%.1f,", median > 0 ? corpusSize / median / 1e9 : 0.0, median > 0 ? matches / median : 0.0);
+	printTimes("time", times);
+	fprintf(resultFile, "}\n");
+	fflush(resultFile);
+}
+
+/**
+* Benchmark building and scanning with one pattern set.
+* Input params:
+* - config: Benchmark settings
+* - patterns: Pattern set
+* - corpus, corpusSize: Text to scan
+* - pool: Threads for the parallel engine
+* - device: OpenCL device, or NULL to skip the pfac engine
+*/
+static void benchPatternSet(const benchConfig& config, const vector<string>& patterns, const char* corpus, size_t corpusSize, threadPool& pool, pfacDevice* device) {
+	vector<const char*> patternsPtr(patterns.size());
+	for (size_t i = 0; i < patterns.size(); i++) patternsPtr[i] = patterns[i].c_str();
+
+	// Build time: trie and DFA on all threads, then trie, compiled DFA and PFAC tables, each timed on its own.
+	trieArena* stateMachine = NULL;
+	automaton* dfa = NULL;
+	pfacTable table;
+	benchTimes trieTimes, parallelTrieTimes, compileTimes, parallelCompileTimes, tableTimes;
+	for (int r = 0; r < config.repetitions; r++) {
+		delete dfa;
+		deleteTrie(stateMachine);
+		double parallelStart = now();
+		stateMachine = constructStateMachineParallel(pool, patterns);
+		double parallelBuilt = now();
+		dfa = compileAutomatonParallel(pool, stateMachine, patterns);
+		parallelCompileTimes.seconds.push_back(now() - parallelBuilt);
+		parallelTrieTimes.seconds.push_back(parallelBuilt - parallelStart);
+		delete dfa;
+		deleteTrie(stateMachine);
+		double start = now();
+		stateMachine = constructStateMachine(patternsPtr.data(), patternsPtr.size());
+		double built = now();
+		dfa = compileAutomaton(stateMachine, patterns);
+		double compiled = now();
+		buildPfacTable(dfa, table);
+		double tabled = now();
+		trieTimes.seconds.push_back(built - start);
+		compileTimes.seconds.push_back(compiled - built);
+		tableTimes.seconds.push_back(tabled - compiled);
+	}
+	sort(trieTimes.seconds.begin(), trieTimes.seconds.end());
+	sort(parallelTrieTimes.seconds.begin(), parallelTrieTimes.seconds.end());
+	sort(compileTimes.seconds.begin(), compileTimes.seconds.end());
+	sort(parallelCompileTimes.seconds.begin(), parallelCompileTimes.seconds.end());
+	sort(tableTimes.seconds.begin(), tableTimes.seconds.end());
+	// Minimization compacts the tombstones removed patterns leave in an incrementalAutomaton; a
+	// compiled automaton is minimal already. It runs on a snapshot with every tenth pattern
+	// removed and only reports its reduction; the engines scan dfa. It takes several times as
+	// long as compiling, so it is timed once.
+	incrementalAutomaton incremental(patterns);
+	for (size_t i = 0; i < patterns.size(); i += 10) incremental.remove(i);
+	automaton* snapshot = incremental.snapshot();
+	minimizeReport reduction;
+	benchTimes minimizeTimes = timeRuns(1, [&] {
+		delete minimizeAutomaton(snapshot, &reduction);
+	});
+	delete snapshot;
+	size_t tableBytes = dfa->transitions.size() * sizeof(int32_t) + dfa->narrowTransitions.size() * sizeof(uint16_t);
+	fprintf(resultFile, "{\"kind\":\"build\",\"patterns\":%zu,\"states\":%d,\"classes\":%d,\"state_bits\":%d,\"pfac_states\":%d,", patterns.size(), dfa->numStates, dfa->numClasses,
+		dfa->narrowTransitions.empty() ? 32 : 16, table.numStates);
+	fprintf(resultFile, "\"table_bytes\":%zu,\"compacted_states\":%d,\"compacted_table_bytes\":%zu,", tableBytes, reduction.statesAfter, reduction.tableBytesAfter);
+	printTimes("trie", trieTimes);
+	fprintf(resultFile, ",");
+	printTimes("parallel_trie", parallelTrieTimes);
+	fprintf(resultFile, ",");
+	printTimes("compile", compileTimes);
+	fprintf(resultFile, ",");
+	printTimes("parallel_compile", parallelCompileTimes);
+	fprintf(resultFile, ",");
+	printTimes("pfac_table", tableTimes);
+	fprintf(resultFile, ",");
+	printTimes("minimize", minimizeTimes);
+	fprintf(resultFile, "}\n");
+
+	// The result buffers are reused across runs, so the timed runs do not allocate once warm.
+	vector<matchEntry> matches;
+	vector<int64_t> counts(dfa->numPatterns);
+	if (engineEnabled(config, "trie")) {
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			matches.clear();
+			scanText(corpus, corpusSize, stateMachine, dfa->patternLength.data(), 0, matches);
+		});
+		printResult("trie", patterns.size(), corpusSize, matches.size(), times);
+	}
+	if (engineEnabled(config, "dfa")) {
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			matches.clear();
+			scanAutomaton(dfa, corpus, corpusSize, 0, matches);
+		});
+		printResult("dfa", patterns.size(), corpusSize, matches.size(), times);
+	}
+	if (engineEnabled(config, "count")) {
+		int64_t total = 0;
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			fill(counts.begin(), counts.end(), 0);
+			countAutomaton(dfa, corpus, corpusSize, counts.data());
+		});
+		for (size_t p = 0; p < counts.size(); p++) total += counts[p];
+		printResult("count", patterns.size(), corpusSize, (size_t)total, times);
+	}
+	if (engineEnabled(config, "interleaved")) {
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			matches.clear();
+			scanInterleaved(dfa, corpus, corpusSize, 0, config.streams, matches);
+		});
+		printResult("interleaved", patterns.size(), corpusSize, matches.size(), times);
+	}
+	if (engineEnabled(config, "parallel")) {
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			matches.clear();
+			scanParallel(pool, dfa, corpus, corpusSize, 0, matches);
+		});
+		printResult("parallel", patterns.size(), corpusSize, matches.size(), times);
+	}
+	if (engineEnabled(config, "records")) {
+		vector<scanRecord> records;
+		for (size_t offset = 0; offset < corpusSize; offset += config.recordSize) {
+			scanRecord record = { corpus + offset, min(config.recordSize, corpusSize - offset) };
+			records.push_back(record);
+		}
+		vector<recordMatch> recordMatches;
+		benchTimes times = timeRuns(config.repetitions, [&] {
+			recordMatches.clear();
+			scanRecords(pool, dfa, records.data(), records.size(), recordMatches);
+		});
+		printResult("records", patterns.size(), corpusSize, recordMatches.size(), times);
+	}
+#ifndef PFAC_NO_OPENCL
+	if (engineEnabled(config, "pfac") && device) {
+		// PFAC reports the longest match per start position, so its match count is lower.
+		if (CL_SUCCESS == pfacOclLoadTable(device, table, config.kernelFile)) {
+			vector<cl_int> patternIds(corpusSize + 1), positions(corpusSize + 1);
+			cl_int numMatched = 0;
+			cl_int err = CL_SUCCESS;
+			benchTimes times = timeRuns(config.repetitions, [&] {
+				if (CL_SUCCESS == err) err = pfacOclMatchCompact(device, corpus, corpusSize, patternIds.data(), positions.data(), &numMatched);
+			});
+			if (CL_SUCCESS == err) printResult("pfac", patterns.size(), corpusSize, (size_t)numMatched, times);
+		}
+	}
+	if (engineEnabled(config, "pipelined") && device) {
+		// Dense output of pfacOclMatchPipelined(); the match count is that of the pfac engine.
+		if (CL_SUCCESS == pfacOclLoadTable(device, table, config.kernelFile)) {
+			vector<cl_int> output(corpusSize);
+			cl_int err = CL_SUCCESS;
+			benchTimes times = timeRuns(config.repetitions, [&] {
+				if (CL_SUCCESS == err) err = pfacOclMatchPipelined(device, corpus, corpusSize, config.chunkSize, output.data());
+			});
+			size_t numMatched = 0;
+			for (size_t i = 0; i < corpusSize; i++) numMatched += output[i] >= 0;
+			if (CL_SUCCESS == err) printResult("pipelined", patterns.size(), corpusSize, numMatched, times);
+		}
+	}
+#else
+	(void)device;
+#endif
+
+	delete dfa;
+	deleteTrie(stateMachine);
+}
+
+static void usage() {
+	printf("Usage: bench [options]\n"
+		"  --patterns N,N,...   generated pattern set sizes (default 10,100,1000,10000,100000)\n"
+		"  --alphabet N         distinct bytes in generated data, 1-26 (default 4)\n"
+		"  --size BYTES         generated corpus size (default 16777216)\n"
+		"  --density D          planted matches per KiB (default 1)\n"
+		"  --length MIN,MAX     generated pattern lengths (default 4,16)\n"
+		"  --reps N             timed runs per engine (default 5)\n"
+		"  --threads N          thread pool size, 0 = one per core (default 0)\n"
+		"  --streams N          lanes of the interleaved engine, 1-16 (default 8)\n"
+		"  --record-size BYTES  record size of the records engine (default 1024)\n"
+		"  --chunk-size BYTES   chunk size of the pipelined engine (default 16 MiB)\n"
+		"  --seed N             generator seed (default 1)\n"
+		"  --corpus FILE        scan FILE instead of a generated corpus\n"
+		"  --pattern-file FILE  use the patterns in FILE instead of generated sets\n"
+		"  --engines LIST       any of trie,dfa,count,interleaved,parallel,records,pfac,\n"
+		"                       pipelined (default all)\n"
+		"  --kernel FILE        PFAC kernel source (default PFAC.cl)\n"
+		"  --prefilter NAME     avx512bw, avx2, ssse3 or scalar (default: best the CPU supports)\n"
+		"  --output FILE        write the results to FILE instead of stdout\n");
+}
+
+static vector<int> parseList(const char* text) {
+	vector<int> values;
+	for (const char* p = text; *p; ) {
+		values.push_back(atoi(p));
+		p = strchr(p, ',');
+		if (!p) break;
+		p++;
+	}
+	return values;
+}
+
+static bool parseArgs(int argc, char** argv, benchConfig& config) {
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (i + 1 >= argc) return false;
+		const char* value = argv[++i];
+		if (arg == "--patterns") config.patternCounts = parseList(value);
+		else if (arg == "--alphabet") config.alphabetSize = atoi(value);
+		else if (arg == "--size") config.corpusSize = (size_t)strtoull(value, NULL, 10);
+		else if (arg == "--density") config.density = atof(value);
+		else if (arg == "--length") {
+			vector<int> range = parseList(value);
+			if (range.size() != 2) return false;
+			config.minPatternLength = range[0];
+			config.maxPatternLength = range[1];
+		}
+		else if (arg == "--reps") config.repetitions = atoi(value);
+		else if (arg == "--threads") config.threads = atoi(value);
+		else if (arg == "--streams") config.streams = atoi(value);
+		else if (arg == "--record-size") config.recordSize = (size_t)strtoull(value, NULL, 10);
+		else if (arg == "--chunk-size") config.chunkSize = (size_t)strtoull(value, NULL, 10);
+		else if (arg == "--seed") config.seed = (unsigned)strtoul(value, NULL, 10);
+		else if (arg == "--corpus") config.corpusFile = value;
+		else if (arg == "--pattern-file") config.patternFile = value;
+		else if (arg == "--engines") config.engines = value;
+		else if (arg == "--kernel") config.kernelFile = value;
+		else if (arg == "--prefilter") config.prefilter = value;
+		else if (arg == "--output") config.outputFile = value;
+		else return false;
+	}
+	return config.alphabetSize >= 1 && config.alphabetSize <= 26 && config.repetitions >= 1 &&
+		config.streams >= 1 && config.streams <= MAX_STREAMS && config.recordSize >= 1 &&
+		config.minPatternLength >= 1 && config.minPatternLength <= config.maxPatternLength;
+}
+
+int main(int argc, char** argv) {
+	benchConfig config;
+	config.patternCounts = parseList("10,100,1000,10000,100000");
+	config.alphabetSize = 4;
+	config.corpusSize = 16 << 20;
+	config.density = 1;
+	config.minPatternLength = 4;
+	config.maxPatternLength = 16;
+	config.repetitions = 5;
+	config.threads = 0;
+	config.streams = 8;
+	config.recordSize = 1024;
+	config.chunkSize = 0;
+	config.seed = 1;
+	config.corpusFile = NULL;
+	config.patternFile = NULL;
+	config.engines = "trie,dfa,count,interleaved,parallel,records,pfac,pipelined";
+	config.kernelFile = "PFAC.cl";
+	config.prefilter = NULL;
+	config.outputFile = NULL;
+	if (!parseArgs(argc, argv, config)) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	if (config.outputFile) {
+		resultFile = fopen(config.outputFile, "w");
+		if (NULL == resultFile) {
+			printf("Error: Failed to open output file '%s'\n", config.outputFile);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (config.prefilter && !selectPrefilter(config.prefilter)) {
+		printf("Error: Prefilter '%s' is unknown or not supported by this CPU\n", config.prefilter);
+		return EXIT_FAILURE;
+	}
+
+	threadPool pool(config.threads);
+	pfacDevice* devicePtr = NULL;
+#ifndef PFAC_NO_OPENCL
+	pfacDevice device;
+	if (engineEnabled(config, "pfac") || engineEnabled(config, "pipelined")) {
+		if (CL_SUCCESS == pfacOclCreate(&device, CL_DEVICE_TYPE_GPU) || CL_SUCCESS == pfacOclCreate(&device, CL_DEVICE_TYPE_CPU)) {
+			devicePtr = &device;
+		}
+		else {
+			fprintf(stderr, "No OpenCL device available, skipping the pfac engines\n");
+		}
+	}
+#endif
+	fprintf(resultFile, "{\"kind\":\"config\",\"threads\":%d,\"alphabet\":%d,\"density\":%.3f,\"length\":[%d,%d],\"reps\":%d,\"seed\":%u,\"prefilter\":\"%s\",\"pfac_device\":%s}\n",
+		pool.size(), config.alphabetSize, config.density, config.minPatternLength, config.maxPatternLength,
+		config.repetitions, config.seed, prefilterName(), devicePtr ? "true" : "false");
+
+	mt19937 rng(config.seed);
+	vector<vector<string>> patternSets;
+	if (config.patternFile) {
+		patternSets.push_back(vector<string>());
+		if (!readPatterns(config.patternFile, patternSets[0])) return EXIT_FAILURE;
+	}
+	else {
+		for (size_t i = 0; i < config.patternCounts.size(); i++) {
+			patternSets.push_back(generatePatterns(config, config.patternCounts[i], rng));
+		}
+	}
+
+	mappedFile corpusFile = { NULL, 0 };
+	if (config.corpusFile && !mapFile(config.corpusFile, &corpusFile, true, true)) return EXIT_FAILURE;
+	for (size_t i = 0; i < patternSets.size(); i++) {
+		// A generated corpus is planted with matches of the set it is scanned with.
+		string generated;
+		if (!config.corpusFile) generated = generateCorpus(config, patternSets[i], rng);
+		const char* corpus = config.corpusFile ? corpusFile.data : generated.data();
+		size_t corpusSize = config.corpusFile ? corpusFile.size : generated.size();
+		benchPatternSet(config, patternSets[i], corpus, corpusSize, pool, devicePtr);
+	}
+
+	unmapFile(&corpusFile);
+#ifndef PFAC_NO_OPENCL
+	if (devicePtr) pfacOclRelease(devicePtr);
+#endif
+	if (config.outputFile) fclose(resultFile);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+// Read-only array that either owns its elements or views elements stored elsewhere,
+// e.g. in a memory-mapped automaton file (see automaton_file.h).
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/**
+* Builders fill a std::vector and hand it over with assign(); the loader of a mapped
+* automaton points the array at the mapping with attach(), without copying. Readers
+* only see const elements either way, so the two cases are interchangeable.
+*/
+template <typename T>
+class flatArray {
+public:
+	flatArray() : ptr(NULL), count(0) {}
+
+	flatArray(const flatArray& other) : owned(other.owned), ptr(other.ptr), count(other.count) {
+		if (other.isOwned()) ptr = owned.data();
+	}
+
+	flatArray& operator=(const flatArray& other) {
+		if (this != &other) {
+			owned = other.owned;
+			ptr = other.isOwned() ? owned.data() : other.ptr;
+			count = other.count;
+		}
+		return *this;
+	}
+
+	// Take over the elements of elements, which is left empty.
+	void assign(std::vector<T>& elements) {
+		owned.swap(elements);
+		elements.clear();
+		ptr = owned.data();
+		count = owned.size();
+	}
+
+	// View n elements owned by someone else. They must stay valid as long as the array is used.
+	void attach(const T* elements, size_t n) {
+		owned.clear();
+		ptr = elements;
+		count = n;
+	}
+
+	const T& operator[](size_t i) const { return ptr[i]; }
+	const T* data() const { return ptr; }
+	const T* begin() const { return ptr; }
+	const T* end() const { return ptr + count; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+private:
+	bool isOwned() const { return !owned.empty() && ptr == owned.data(); }
+
+	std::vector<T> owned;
+	const T* ptr;
+	size_t count;
+};
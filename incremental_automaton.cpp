@@ -0,0 +1,359 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include "incremental_automaton.h"
+
+using namespace std;
+
+/**
+* Build the automaton of an initial pattern set, like trie(), defineFailures() and
+* compileAutomaton() do, but with the states numbered like the trie nodes.
+* Pattern IDs are the indices in patterns; insert() continues after the last one.
+* The patterns must not be empty, see insert().
+*/
+incrementalAutomaton::incrementalAutomaton(const vector<string>& patterns) {
+	for (size_t i = 0; i < patterns.size(); i++) assert(!patterns[i].empty());
+	tree = trie(patterns);
+	defineFailures(tree);
+	const vector<node>& nodes = tree->nodes;
+	size_t numNodes = nodes.size();
+
+	numClasses = buildClassMap(patterns, classOf);
+	memset(byteUsed, 0, sizeof(byteUsed));
+	maxPatternLength = 0;
+	for (size_t i = 0; i < patterns.size(); i++) {
+		for (size_t j = 0; j < patterns[i].length(); j++) byteUsed[(uint8_t)patterns[i][j]] = true;
+		patternLength.push_back(patterns[i].length());
+		maxPatternLength = max(maxPatternLength, (int32_t)patterns[i].length());
+	}
+
+	parent.assign(numNodes, NO_NODE);
+	depth.assign(numNodes, 0);
+	firstFailureChild.assign(numNodes, NO_NODE);
+	nextFailureSibling.assign(numNodes, NO_NODE);
+	prevFailureSibling.assign(numNodes, NO_NODE);
+	patternNode.assign(patterns.size(), NO_NODE);
+	outputLink.assign(numNodes, -1);
+	finalPattern.assign(numNodes, -1);
+
+	// BFS order, so that every failure row is complete before it is copied.
+	vector<uint32_t> order(1, 0);
+	order.reserve(numNodes);
+	for (size_t k = 0; k < order.size(); k++) {
+		for (uint32_t child = nodes[order[k]].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+			parent[child] = order[k];
+			depth[child] = depth[order[k]] + 1;
+			order.push_back(child);
+		}
+	}
+
+	transitions.assign(numNodes * numClasses, 0);
+	for (size_t k = 0; k < numNodes; k++) {
+		uint32_t n = order[k];
+		if (n != 0) linkFailure(n);
+		computeRow(n, &transitions[(size_t)n * numClasses]);
+		setOutputLink(n, nodes[n].outputLink);
+		finalPattern[n] = nodes[n].firstPattern;
+		for (int32_t p = nodes[n].firstPattern; p >= 0; p = tree->nextPattern[p]) patternNode[p] = n;
+	}
+	refreshView();
+}
+
+incrementalAutomaton::~incrementalAutomaton() {
+	deleteTrie(tree);
+}
+
+/**
+* Add a pattern. Its ID is one more than the last ID handed out, whether or not that pattern
+* has been removed since. The empty pattern is rejected: it would end in the root and match
+* at every position, which no pattern loader produces (they all skip empty lines).
+* Returns the pattern ID, or -1 for the empty pattern.
+*/
+int32_t incrementalAutomaton::insert(const string& pattern) {
+	if (pattern.empty()) return -1;
+	int32_t id = patternLength.size();
+	for (size_t j = 0; j < pattern.length(); j++) {
+		if (!byteUsed[(uint8_t)pattern[j]]) addClass((uint8_t)pattern[j]);
+	}
+
+	// The part of the path that is not in the trie yet.
+	uint32_t n = 0;
+	vector<uint32_t> created;
+	for (size_t j = 0; j < pattern.length(); j++) {
+		uint32_t child = childOf(tree, n, (uint8_t)pattern[j]);
+		if (NO_NODE == child) {
+			child = addNode(n, (uint8_t)pattern[j]);
+			created.push_back(child);
+		}
+		n = child;
+	}
+
+	// Shallowest first, so every failure node a new node can get is already linked.
+	vector<uint32_t> dirty;
+	if (!created.empty()) dirty.push_back(parent[created[0]]);
+	for (size_t i = 0; i < created.size(); i++) {
+		uint32_t w = created[i];
+		defineFailure(tree, parent[w], w);
+		setOutputLink(w, tree->nodes[w].outputLink);
+		repointFailures(w, dirty);
+		linkFailure(w);
+		dirty.push_back(w);
+	}
+
+	patternLength.push_back(pattern.length());
+	patternNode.push_back(n);
+	tree->nextPattern.push_back(-1);
+	maxPatternLength = max(maxPatternLength, (int32_t)pattern.length());
+	bool hadPatterns = tree->nodes[n].firstPattern >= 0;
+	// The largest ID so far goes last in the node's chain, which holds only identical patterns.
+	int32_t* link = &tree->nodes[n].firstPattern;
+	while (*link >= 0) link = &tree->nextPattern[*link];
+	*link = id;
+	finalPattern[n] = tree->nodes[n].firstPattern;
+	if (!hadPatterns) relinkOutputs(n, tree->nodes[n].outputLink, n);
+
+	// A row depends on the row of its failure node, so rows are redone shallowest first.
+	const vector<int32_t>& nodeDepth = depth;
+	sort(dirty.begin(), dirty.end(), [&](uint32_t a, uint32_t b) {
+		return nodeDepth[a] != nodeDepth[b] ? nodeDepth[a] < nodeDepth[b] : a < b;
+	});
+	dirty.erase(unique(dirty.begin(), dirty.end()), dirty.end());
+	for (size_t i = 0; i < dirty.size(); i++) updateRow(dirty[i]);
+
+	refreshView();
+	return id;
+}
+
+/**
+* Remove a pattern. Its trie path stays as a tombstone; only the output links that led to
+* the pattern's node change, and only if no other pattern ends there.
+* Returns false if id was never handed out or is already removed.
+*/
+bool incrementalAutomaton::remove(int32_t id) {
+	if (id < 0 || id >= (int32_t)patternNode.size() || NO_NODE == patternNode[id]) return false;
+	uint32_t n = patternNode[id];
+	int32_t* link = &tree->nodes[n].firstPattern;
+	while (*link != id) link = &tree->nextPattern[*link];
+	*link = tree->nextPattern[id];
+	tree->nextPattern[id] = -1;
+	patternNode[id] = NO_NODE;
+	finalPattern[n] = tree->nodes[n].firstPattern;
+	if (tree->nodes[n].firstPattern < 0) relinkOutputs(n, n, tree->nodes[n].outputLink);
+	refreshView();
+	return true;
+}
+
+/**
+* Copy of the current automaton that owns its tables, e.g. to publish through an
+* automatonSwap while this one keeps changing. Unlike view(), it stores the narrow table
+* instead if it is small enough, see setTransitions().
+*/
+automaton* incrementalAutomaton::snapshot() const {
+	automaton* copy = new automaton();
+	copy->numStates = dfa.numStates;
+	copy->numClasses = dfa.numClasses;
+	copy->numPatterns = dfa.numPatterns;
+	copy->maxPatternLength = dfa.maxPatternLength;
+	memcpy(copy->classOf, dfa.classOf, sizeof(copy->classOf));
+	const vector<int32_t>* from[] = { &outputLink, &depth, &patternLength, &finalPattern, &tree->nextPattern };
+	flatArray<int32_t>* to[] = { &copy->outputLink, &copy->depth, &copy->patternLength, &copy->finalPattern, &copy->nextPattern };
+	for (size_t i = 0; i < sizeof(from) / sizeof(from[0]); i++) {
+		vector<int32_t> elements(*from[i]);
+		to[i]->assign(elements);
+	}
+	vector<int32_t> table(transitions);
+	setTransitions(copy, table);
+	copy->prefilter = dfa.prefilter;
+	return copy;
+}
+
+/**
+* Give byte b, which no pattern used so far, a class of its own. Until now b behaved like
+* every other unused byte, i.e. like class 0, so its new column starts as a copy of column 0.
+*/
+void incrementalAutomaton::addClass(uint8_t b) {
+	byteUsed[b] = true;
+	int numUnused = 0;
+	for (int x = 0; x < 256; x++) numUnused += !byteUsed[x];
+	// b was the last byte in class 0, which from now on stands for b alone.
+	if (0 == numUnused) return;
+
+	size_t numStates = tree->nodes.size();
+	int32_t widened = numClasses + 1;
+	vector<int32_t> table(numStates * widened);
+	for (size_t s = 0; s < numStates; s++) {
+		const int32_t* row = &transitions[s * numClasses];
+		copy(row, row + numClasses, &table[s * widened]);
+		table[s * widened + numClasses] = row[0];
+	}
+	transitions.swap(table);
+	classOf[b] = (uint8_t)numClasses;
+	numClasses = widened;
+}
+
+// Append a trie node below parent on label. Its failure link and row are set by the caller.
+uint32_t incrementalAutomaton::addNode(uint32_t parentNode, uint8_t label) {
+	vector<node>& nodes = tree->nodes;
+	uint32_t n = nodes.size();
+	node created = { NO_NODE, nodes[parentNode].firstChild, NO_NODE, -1, NO_NODE, label };
+	nodes.push_back(created);
+	nodes[parentNode].firstChild = n;
+	if (parentNode == 0) tree->rootChildren[label] = n;
+	parent.push_back(parentNode);
+	depth.push_back(depth[parentNode] + 1);
+	firstFailureChild.push_back(NO_NODE);
+	nextFailureSibling.push_back(NO_NODE);
+	prevFailureSibling.push_back(NO_NODE);
+	transitions.resize(transitions.size() + numClasses, 0);
+	outputLink.push_back(-1);
+	finalPattern.push_back(-1);
+	return n;
+}
+
+// Add n to the inverse failure tree below its failure node.
+void incrementalAutomaton::linkFailure(uint32_t n) {
+	uint32_t failure = tree->nodes[n].failure;
+	uint32_t next = firstFailureChild[failure];
+	if (next != NO_NODE) prevFailureSibling[next] = n;
+	nextFailureSibling[n] = next;
+	prevFailureSibling[n] = NO_NODE;
+	firstFailureChild[failure] = n;
+}
+
+// Take n out of the inverse failure tree, before its failure link changes.
+void incrementalAutomaton::unlinkFailure(uint32_t n) {
+	uint32_t prev = prevFailureSibling[n];
+	uint32_t next = nextFailureSibling[n];
+	if (prev != NO_NODE) nextFailureSibling[prev] = next;
+	else firstFailureChild[tree->nodes[n].failure] = next;
+	if (next != NO_NODE) prevFailureSibling[next] = prev;
+	nextFailureSibling[n] = NO_NODE;
+	prevFailureSibling[n] = NO_NODE;
+}
+
+// Set the output link of n in the trie and in the table.
+void incrementalAutomaton::setOutputLink(uint32_t n, uint32_t link) {
+	tree->nodes[n].outputLink = link;
+	outputLink[n] = (link == NO_NODE) ? -1 : (int32_t)link;
+}
+
+/**
+* Below n in the inverse failure tree, move the output links that point at from to to.
+* A node with patterns of its own ends the walk, as the nodes below it link to it.
+*/
+void incrementalAutomaton::relinkOutputs(uint32_t n, uint32_t from, uint32_t to) {
+	vector<uint32_t> stack;
+	for (uint32_t y = firstFailureChild[n]; y != NO_NODE; y = nextFailureSibling[y]) stack.push_back(y);
+	while (!stack.empty()) {
+		uint32_t y = stack.back();
+		stack.pop_back();
+		if (tree->nodes[y].outputLink != from) continue;
+		setOutputLink(y, to);
+		if (tree->nodes[y].firstPattern >= 0) continue;
+		for (uint32_t z = firstFailureChild[y]; z != NO_NODE; z = nextFailureSibling[z]) stack.push_back(z);
+	}
+}
+
+/**
+* Point the failure links that should now end in the new node w at it. Such a node is the
+* child on w's label of a node x whose string ends with that of w's parent, i.e. of x below
+* parent(w) in the inverse failure tree. Below an x that has that child, the failure links
+* already lead to a node deeper than w, so the walk stops there. The moved nodes are added
+* to dirty, as their rows change.
+*/
+void incrementalAutomaton::repointFailures(uint32_t w, vector<uint32_t>& dirty) {
+	vector<node>& nodes = tree->nodes;
+	uint8_t label = nodes[w].label;
+	uint32_t moved = (nodes[w].firstPattern >= 0) ? w : nodes[w].outputLink;
+	vector<uint32_t> stack;
+	for (uint32_t x = firstFailureChild[parent[w]]; x != NO_NODE; x = nextFailureSibling[x]) stack.push_back(x);
+	while (!stack.empty()) {
+		uint32_t x = stack.back();
+		stack.pop_back();
+		uint32_t u = childOf(tree, x, label);
+		if (NO_NODE == u) {
+			for (uint32_t y = firstFailureChild[x]; y != NO_NODE; y = nextFailureSibling[y]) stack.push_back(y);
+			continue;
+		}
+		if (depth[nodes[u].failure] < depth[w]) {
+			unlinkFailure(u);
+			nodes[u].failure = w;
+			linkFailure(u);
+			setOutputLink(u, moved);
+			dirty.push_back(u);
+		}
+	}
+}
+
+// Row of n as compileAutomaton() builds it: the row of its failure node with its own children written over it.
+void incrementalAutomaton::computeRow(uint32_t n, int32_t* row) const {
+	const vector<node>& nodes = tree->nodes;
+	if (n == 0) fill(row, row + numClasses, 0);
+	else {
+		const int32_t* failureRow = &transitions[(size_t)nodes[n].failure * numClasses];
+		copy(failureRow, failureRow + numClasses, row);
+	}
+	for (uint32_t child = nodes[n].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+		row[classOf[nodes[child].label]] = child;
+	}
+}
+
+/**
+* Recompute the row of n and copy the classes that changed down the inverse failure tree,
+* into every row that takes the class from its failure node rather than from a child.
+*/
+void incrementalAutomaton::updateRow(uint32_t n) {
+	const vector<node>& nodes = tree->nodes;
+	vector<int32_t> row(numClasses);
+	computeRow(n, row.data());
+	int32_t* current = &transitions[(size_t)n * numClasses];
+	vector<int32_t> changed;
+	for (int32_t k = 0; k < numClasses; k++) {
+		if (current[k] != row[k]) {
+			current[k] = row[k];
+			changed.push_back(k);
+		}
+	}
+
+	vector<pair<uint32_t, vector<int32_t> > > stack;
+	if (!changed.empty()) stack.push_back(make_pair(n, changed));
+	vector<bool> hasChild(numClasses, false);
+	while (!stack.empty()) {
+		uint32_t x = stack.back().first;
+		vector<int32_t> classes;
+		classes.swap(stack.back().second);
+		stack.pop_back();
+		const int32_t* from = &transitions[(size_t)x * numClasses];
+		for (uint32_t y = firstFailureChild[x]; y != NO_NODE; y = nextFailureSibling[y]) {
+			for (uint32_t c = nodes[y].firstChild; c != NO_NODE; c = nodes[c].nextSibling) hasChild[classOf[nodes[c].label]] = true;
+			int32_t* to = &transitions[(size_t)y * numClasses];
+			changed.clear();
+			for (size_t i = 0; i < classes.size(); i++) {
+				int32_t k = classes[i];
+				if (!hasChild[k] && to[k] != from[k]) {
+					to[k] = from[k];
+					changed.push_back(k);
+				}
+			}
+			for (uint32_t c = nodes[y].firstChild; c != NO_NODE; c = nodes[c].nextSibling) hasChild[classOf[nodes[c].label]] = false;
+			if (!changed.empty()) stack.push_back(make_pair(y, changed));
+		}
+	}
+}
+
+// Point the automaton at the current tables, which may have been reallocated.
+void incrementalAutomaton::refreshView() {
+	dfa.numStates = tree->nodes.size();
+	dfa.numClasses = numClasses;
+	dfa.numPatterns = patternLength.size();
+	dfa.maxPatternLength = maxPatternLength;
+	memcpy(dfa.classOf, classOf, sizeof(dfa.classOf));
+	dfa.transitions.attach(transitions.data(), transitions.size());
+	dfa.outputLink.attach(outputLink.data(), outputLink.size());
+	dfa.depth.attach(depth.data(), depth.size());
+	dfa.patternLength.attach(patternLength.data(), patternLength.size());
+	dfa.finalPattern.attach(finalPattern.data(), finalPattern.size());
+	dfa.nextPattern.attach(tree->nextPattern.data(), tree->nextPattern.size());
+	initPrefilter(&dfa);
+}
@@ -0,0 +1,97 @@
+// Pattern sets that change by small deltas. Instead of rebuilding the trie, the failure
+// links and the transition table from scratch, adding or removing a pattern recomputes
+// only the trie path, failure links, output links and table rows that depend on it.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "trie.h"
+#include "automaton.h"
+
+/**
+* An automaton that patterns can be added to and removed from.
+*
+* The states are the trie nodes, numbered in creation order rather than BFS order, and the
+* dense table is kept in a growable vector that view() exposes in place. Besides the trie,
+* every node keeps its parent, its depth and the list of nodes whose failure link points at
+* it (the inverse failure tree). Adding a pattern then works like this:
+* - The missing suffix of its path is appended to the trie.
+* - Every new node w gets its failure link as in defineFailures(). The nodes whose failure
+*   link moves to w are exactly the nodes u = x + c for x in the inverse failure subtree of
+*   parent(w) and c the label of w. The walk stops at the first such x on every branch that
+*   has a child on c, because below it the failure links stay deeper than w.
+* - Output links change only in the inverse failure subtree of the node that gained a pattern.
+* - A row is the row of the failure node with the node's children written over it, so rows
+*   are recomputed for the new nodes, the parent of the new path and the nodes whose failure
+*   link moved, shallowest first. A class that changes in a row is copied down the inverse
+*   failure tree into every row that takes that class from it.
+*
+* Removing a pattern leaves its trie path in place as a tombstone and only unlinks the
+* pattern, so no failure link or row changes. Removed IDs are not reused and simply never
+* match. Once the tombstones take up too much memory, rebuild from scratch or pass a
+* snapshot() through minimizeAutomaton(), which merges every tombstone into the state it
+* behaves like.
+*
+* Costs: the work is proportional to the rows and links that really change, with two
+* exceptions. A new byte that starts a pattern where none started before changes the row of
+* every state without a child on it. And a byte that occurs in no pattern so far adds a
+* column to the table, which re-lays out the whole table. The patterns of a state are the
+* trie's chain of identical patterns (automaton::nextPattern), so adding or removing one
+* only walks that chain.
+*
+* Patterns must not be empty: the constructor asserts it and insert() rejects them.
+*
+* view() changes under the caller, so nothing may scan it during insert() or remove().
+* For scanners that keep running, publish a snapshot() through an automatonSwap.
+*/
+class incrementalAutomaton {
+public:
+	explicit incrementalAutomaton(const std::vector<std::string>& patterns);
+	~incrementalAutomaton();
+
+	int32_t insert(const std::string& pattern);
+
+	bool remove(int32_t id);
+
+	// The automaton, valid until the next insert() or remove(). It has no narrow table, see snapshot().
+	const automaton* view() const { return &dfa; }
+
+	automaton* snapshot() const;
+
+private:
+	incrementalAutomaton(const incrementalAutomaton&);
+	incrementalAutomaton& operator=(const incrementalAutomaton&);
+
+	void addClass(uint8_t b);
+	uint32_t addNode(uint32_t parent, uint8_t label);
+	void linkFailure(uint32_t n);
+	void unlinkFailure(uint32_t n);
+	void setOutputLink(uint32_t n, uint32_t link);
+	void relinkOutputs(uint32_t n, uint32_t from, uint32_t to);
+	void repointFailures(uint32_t w, std::vector<uint32_t>& dirty);
+	void computeRow(uint32_t n, int32_t* row) const;
+	void updateRow(uint32_t n);
+	void refreshView();
+
+	trieArena* tree;
+	std::vector<uint32_t> parent;
+	std::vector<int32_t> depth;
+	// Inverse failure tree: children of a node are the nodes whose failure link points at it.
+	std::vector<uint32_t> firstFailureChild;
+	std::vector<uint32_t> nextFailureSibling;
+	std::vector<uint32_t> prevFailureSibling;
+	// Node of every pattern ID, NO_NODE once removed.
+	std::vector<uint32_t> patternNode;
+	std::vector<int32_t> patternLength;
+	bool byteUsed[256];
+	int32_t numClasses;
+	uint8_t classOf[256];
+	int32_t maxPatternLength;
+	std::vector<int32_t> transitions;
+	std::vector<int32_t> outputLink;
+	std::vector<int32_t> finalPattern;
+	automaton dfa;
+};
@@ -0,0 +1,129 @@
+#include <stdio.h>
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+* Map a file read-only. The pages are only read in as they are touched.
+* Input params:
+* - fileName: File to map
+* - file: Receives the mapping; release it with unmapFile()
+* - sequential: The file is read from front to back, like scanner input. The kernel reads
+*   ahead more aggressively. This is only a hint: pages already read stay mapped and
+*   resident until memory pressure reclaims them or the file is unmapped, so resident
+*   memory still grows up to the file size, unless the caller drops them with
+*   releaseMappedRange() as it goes. Otherwise the whole file is requested up front,
+*   as suits lookup tables.
+* - hugePages: Ask for transparent huge pages on the mapping (Linux). Only a hint: it needs
+*   kernel support for huge pages on file mappings and is ignored elsewhere.
+* Returns false, after printing the reason, if the file cannot be opened or mapped.
+*/
+bool mapFile(const char* fileName, mappedFile* file, bool sequential, bool hugePages) {
+	file->data = NULL;
+	file->size = 0;
+#ifdef _WIN32
+	(void)hugePages; // Large pages are only available for pagefile-backed sections.
+	HANDLE fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (INVALID_HANDLE_VALUE == fileHandle) {
+		printf("Error: Failed to open file '%s'\n", fileName);
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		printf("Error: Failed to get the size of file '%s'\n", fileName);
+		CloseHandle(fileHandle);
+		return false;
+	}
+	if (fileSize.QuadPart == 0) {
+		CloseHandle(fileHandle);
+		return true;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* data = mappingHandle ? MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (mappingHandle) CloseHandle(mappingHandle);
+	CloseHandle(fileHandle);
+	if (NULL == data) {
+		printf("Error: Failed to map file '%s'\n", fileName);
+		return false;
+	}
+	file->data = (const char*)data;
+	file->size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Failed to open file '%s'\n", fileName);
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		printf("Error: Failed to get the size of file '%s'\n", fileName);
+		close(fd);
+		return false;
+	}
+	if (info.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == data) {
+		printf("Error: Failed to map file '%s'\n", fileName);
+		return false;
+	}
+	file->data = (const char*)data;
+	file->size = (size_t)info.st_size;
+	madvise(data, file->size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+	if (hugePages) madvise(data, file->size, MADV_HUGEPAGE);
+#else
+	(void)hugePages;
+#endif
+#endif
+	return true;
+}
+
+/**
+* Release behind: drop the resident pages of bytes [begin, end) of a mapping, for callers that
+* read the file once and are done with that part of it. The pages stay mapped and are read
+* in again if touched, so it is only a matter of memory use. Only whole pages inside the range
+* are dropped. On Windows the pages are left to the working set manager.
+* Input params:
+* - file: Mapping made by mapFile()
+* - begin, end: Byte range of the file that will not be read again.
+*/
+void releaseMappedRange(const mappedFile* file, size_t begin, size_t end) {
+#ifdef _WIN32
+	(void)file;
+	(void)begin;
+	(void)end;
+#else
+	if (NULL == file->data || end > file->size) end = file->size;
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t first = (begin + pageSize - 1) / pageSize * pageSize;
+	size_t last = end == file->size ? end : end / pageSize * pageSize;
+	if (first < last) madvise((void*)(file->data + first), last - first, MADV_DONTNEED);
+#endif
+}
+
+// Unmap a file mapped by mapFile(). Safe to call on an empty or zero-initialized mappedFile.
+void unmapFile(mappedFile* file) {
+	if (file->data) {
+#ifdef _WIN32
+		UnmapViewOfFile(file->data);
+#else
+		munmap((void*)file->data, file->size);
+#endif
+	}
+	file->data = NULL;
+	file->size = 0;
+}
@@ -0,0 +1,23 @@
+// Read-only memory mapping of an input file, so the scanners work directly on the
+// file's pages instead of on a copy.
+
+#pragma once
+
+#include <stddef.h>
+
+/**
+* A file mapped read-only into memory. The file handles are closed once the mapping
+* exists; the mapping alone keeps the pages available.
+* - data: First byte of the file; NULL for an empty file.
+* - size: File size in bytes.
+*/
+struct mappedFile {
+	const char* data;
+	size_t size;
+};
+
+bool mapFile(const char* fileName, mappedFile* file, bool sequential, bool hugePages);
+
+void releaseMappedRange(const mappedFile* file, size_t begin, size_t end);
+
+void unmapFile(mappedFile* file);
@@ -22,18 +22,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <tchar.h>
-#include <memory.h>
-#include <windows.h>
-#include "CL\cl.h"
-#include "CL\cl_ext.h"
+#include <stdarg.h>
+#include <string.h>
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
 #include "ocl_utils.h"
 #include <assert.h>
 
 
 //we want to use POSIX functions
+#ifdef _MSC_VER
 #pragma warning( push )
 #pragma warning( disable : 4996 )
+#endif
 
 
 void LogInfo(const char* str, ...)
@@ -70,7 +71,7 @@ int ReadSourceFromFile(const char* fileName, char** source, size_t* sourceSize)
     int errorCode = CL_SUCCESS;
 
     FILE* fp = NULL;
-    fopen_s(&fp, fileName, "rb");
+    fp = fopen(fileName, "rb");
     if (fp == NULL)
     {
         LogError("Error: Couldn't find program source file '%s'.\n", fileName);
@@ -164,4 +165,6 @@ const char* TranslateOpenCLError(cl_int errorCode)
 		return "UNKNOWN ERROR CODE";
 	}
 }
-#pragma warning( pop )
\ No newline at end of file
+#ifdef _MSC_VER
+#pragma warning( pop )
+#endif
\ No newline at end of file
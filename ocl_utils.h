@@ -20,8 +20,7 @@
  * problem reports or change requests be submitted to it directly
  *****************************************************************************/
 
-#include "CL\cl.h"
-#include <d3d9.h>
+#include <CL/cl.h>
 
 
 #pragma once
@@ -0,0 +1,157 @@
+#include "parallel_build.h"
+
+using namespace std;
+
+// Nodes of a level per task of defineFailuresParallel() and compileAutomatonParallel(). Large enough to hide the dispatch, small enough to balance.
+const size_t LEVEL_TASK_SIZE = 4096;
+
+// Child of local node n of a shard on byte b, NO_NODE if there is none.
+static uint32_t shardChildOf(const vector<node>& shard, uint32_t n, uint8_t b) {
+	for (uint32_t c = shard[n].firstChild; c != NO_NODE; c = shard[c].nextSibling) {
+		if (shard[c].label == b) return c;
+	}
+	return NO_NODE;
+}
+
+/**
+* Insert the patterns starting with byte first into a subtree of its own. Node 0 of the
+* shard is the child of the root on first; links between shard nodes are shard indices.
+* Input params:
+* - patterns: All patterns
+* - ids: IDs of the patterns of this shard, in increasing order
+* - first: First byte of these patterns
+* - nextPattern: Chains of identical patterns; only the entries of ids are written
+* - shard: Receives the nodes
+*/
+static void buildShard(const vector<string>& patterns, const vector<int32_t>& ids, uint8_t first, int32_t* nextPattern, vector<node>& shard) {
+	size_t totalLength = 0;
+	for (size_t i = 0; i < ids.size(); i++) totalLength += patterns[ids[i]].length() - 1;
+	shard.reserve(totalLength + 1);
+	node top = { NO_NODE, NO_NODE, NO_NODE, -1, NO_NODE, first };
+	shard.push_back(top);
+
+	for (size_t i = 0; i < ids.size(); i++) {
+		const string& pattern = patterns[ids[i]];
+		uint32_t n = 0;
+		for (size_t j = 1; j < pattern.length(); j++) {
+			uint8_t letter = (uint8_t)pattern[j];
+			uint32_t child = shardChildOf(shard, n, letter);
+			if (NO_NODE == child) {
+				child = (uint32_t)shard.size();
+				node created = { NO_NODE, shard[n].firstChild, NO_NODE, -1, NO_NODE, letter };
+				shard.push_back(created);
+				shard[n].firstChild = child;
+			}
+			n = child;
+		}
+		// Append to the chain of identical patterns, keeping it in ID order.
+		int32_t* link = &shard[n].firstPattern;
+		while (*link >= 0) link = &nextPattern[*link];
+		*link = ids[i];
+	}
+}
+
+trieArena* constructStateMachineParallel(threadPool& pool, const vector<string>& patterns) {
+	trieArena* tree = new trieArena();
+	tree->nextPattern.assign(patterns.size(), -1);
+	node root = { NO_NODE, NO_NODE, NO_NODE, -1, NO_NODE, 0 };
+
+	// Empty patterns end in the root; they are chained in ID order like any other.
+	vector<int32_t> ids[ALPHA_SIZE];
+	int32_t* link = &root.firstPattern;
+	for (size_t i = 0; i < patterns.size(); i++) {
+		if (patterns[i].empty()) {
+			*link = (int32_t)i;
+			link = &tree->nextPattern[i];
+		}
+		else {
+			ids[(uint8_t)patterns[i][0]].push_back((int32_t)i);
+		}
+	}
+
+	vector<node> shards[ALPHA_SIZE];
+	int32_t* nextPattern = tree->nextPattern.data();
+	pool.parallelFor(ALPHA_SIZE, [&](int b) {
+		if (!ids[b].empty()) buildShard(patterns, ids[b], (uint8_t)b, nextPattern, shards[b]);
+	});
+
+	// Shards are laid out after the root in byte order.
+	uint32_t base[ALPHA_SIZE];
+	size_t numNodes = 1;
+	for (int b = 0; b < ALPHA_SIZE; b++) {
+		base[b] = (uint32_t)numNodes;
+		numNodes += shards[b].size();
+	}
+	tree->nodes.resize(numNodes);
+	tree->nodes[0] = root;
+	pool.parallelFor(ALPHA_SIZE, [&](int b) {
+		node* out = &tree->nodes[base[b]];
+		for (size_t k = 0; k < shards[b].size(); k++) {
+			node n = shards[b][k];
+			if (n.firstChild != NO_NODE) n.firstChild += base[b];
+			if (n.nextSibling != NO_NODE) n.nextSibling += base[b];
+			out[k] = n;
+		}
+		vector<node>().swap(shards[b]);
+	});
+
+	// The root's children are listed in byte order.
+	uint32_t* next = &tree->nodes[0].firstChild;
+	for (int b = 0; b < ALPHA_SIZE; b++) {
+		tree->rootChildren[b] = ids[b].empty() ? NO_NODE : base[b];
+		if (ids[b].empty()) continue;
+		*next = base[b];
+		next = &tree->nodes[base[b]].nextSibling;
+	}
+
+	defineFailuresParallel(pool, tree);
+	return tree;
+}
+
+void defineFailuresParallel(threadPool& pool, trieArena* tree) {
+	if (!tree) return;
+	const vector<node>& nodes = tree->nodes;
+
+	vector<uint32_t> level(1, 0);
+	vector<vector<uint32_t> > children;
+	while (!level.empty()) {
+		// Every task links the children of a slice of the level and collects them, in order, as the next level.
+		int numTasks = (int)((level.size() + LEVEL_TASK_SIZE - 1) / LEVEL_TASK_SIZE);
+		children.resize(numTasks);
+		pool.parallelFor(numTasks, [&](int t) {
+			size_t begin = (size_t)t * LEVEL_TASK_SIZE;
+			size_t end = begin + LEVEL_TASK_SIZE < level.size() ? begin + LEVEL_TASK_SIZE : level.size();
+			children[t].clear();
+			for (size_t k = begin; k < end; k++) {
+				uint32_t parent = level[k];
+				for (uint32_t child = nodes[parent].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+					children[t].push_back(child);
+					defineFailure(tree, parent, child);
+				}
+			}
+		});
+
+		level.clear();
+		for (int t = 0; t < numTasks; t++) {
+			level.insert(level.end(), children[t].begin(), children[t].end());
+		}
+	}
+}
+
+automaton* compileAutomatonParallel(threadPool& pool, const trieArena* tree, const vector<string>& patterns) {
+	if (!tree) return NULL;
+	automatonBuild build;
+	beginAutomaton(tree, patterns, build);
+
+	for (size_t d = 0; d + 1 < build.levelStart.size(); d++) {
+		size_t begin = build.levelStart[d];
+		size_t end = build.levelStart[d + 1];
+		int numTasks = (int)((end - begin + LEVEL_TASK_SIZE - 1) / LEVEL_TASK_SIZE);
+		pool.parallelFor(numTasks, [&](int t) {
+			size_t first = begin + (size_t)t * LEVEL_TASK_SIZE;
+			size_t last = first + LEVEL_TASK_SIZE < end ? first + LEVEL_TASK_SIZE : end;
+			for (size_t s = first; s < last; s++) compileState(tree, build, (int32_t)s);
+		});
+	}
+	return finishAutomaton(tree, build);
+}
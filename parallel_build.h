@@ -0,0 +1,48 @@
+// Multi-threaded construction of the Aho Corasick trie and automaton, for pattern sets large enough
+// that building takes longer than scanning.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "trie.h"
+#include "automaton.h"
+#include "parallel_scan.h"
+
+/**
+* Build the trie of a pattern list with failure links on all threads of the pool; the
+* result matches exactly like trie() followed by defineFailures(). Pattern IDs are the
+* indices in the list.
+* The patterns are sharded by their first byte and every shard is inserted into a subtree
+* of its own, so shards need no locking; the subtrees are then copied below the root side
+* by side. The failure links follow with defineFailuresParallel().
+* Sibling order, and with it the BFS numbering of the compiled states, may differ from
+* trie(), but it depends only on the patterns, not on the number of threads.
+* Input params:
+* - pool: Threads to build on
+* - patterns: Pattern set
+*/
+trieArena* constructStateMachineParallel(threadPool& pool, const std::vector<std::string>& patterns);
+
+/**
+* Parallel version of defineFailures(). The failure node of a node at depth d is at most d - 1
+* deep, so the trie is processed one level at a time: all nodes of a level are linked in
+* parallel once the level above is complete.
+* Input params:
+* - pool: Threads to build on
+* - tree: Trie built by trie() or constructStateMachineParallel()
+*/
+void defineFailuresParallel(threadPool& pool, trieArena* tree);
+
+/**
+* Parallel version of compileAutomaton(), with the same result. The row of a state starts as a
+* copy of its failure node's row, which is shallower, so the states are compiled one BFS level
+* at a time like in defineFailuresParallel(). Numbering the states stays sequential; it is
+* linear in the trie nodes while the rows are numStates x numClasses.
+* Input params:
+* - pool: Threads to build on
+* - tree: Trie with failure links already defined
+* - patterns: Patterns the trie was built from. Their indices become the pattern IDs.
+*/
+automaton* compileAutomatonParallel(threadPool& pool, const trieArena* tree, const std::vector<std::string>& patterns);
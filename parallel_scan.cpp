@@ -0,0 +1,189 @@
+#include "parallel_scan.h"
+
+using namespace std;
+
+// Bytes of input per task of scanRecords(). Large enough to hide the dispatch, small enough to balance.
+const size_t RECORD_TASK_SIZE = 64 * 1024;
+
+threadPool::threadPool(int numThreads)
+	: numThreads(numThreads), job(NULL), jobCount(0), nextTask(0), finishedWorkers(0), generation(0), stopping(false) {
+	if (this->numThreads <= 0) {
+		this->numThreads = thread::hardware_concurrency();
+		if (this->numThreads <= 0) this->numThreads = 1;
+	}
+	for (int i = 1; i < this->numThreads; i++) {
+		workers.push_back(thread(&threadPool::workerLoop, this));
+	}
+}
+
+threadPool::~threadPool() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+void threadPool::runTasks(const function<void(int)>& task, int count) {
+	for (int i = nextTask++; i < count; i = nextTask++) {
+		task(i);
+	}
+}
+
+/**
+* Every worker takes part in every job and checks in when it is done, so a job is
+* never replaced while a worker can still see it.
+*/
+void threadPool::workerLoop() {
+	unsigned long seen = 0;
+	for (;;) {
+		const function<void(int)>* task;
+		int count;
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			task = job;
+			count = jobCount;
+		}
+		runTasks(*task, count);
+		{
+			lock_guard<mutex> guard(lock);
+			finishedWorkers++;
+		}
+		done.notify_all();
+	}
+}
+
+void threadPool::parallelFor(int count, const function<void(int)>& task) {
+	if (count <= 0) return;
+	if (workers.empty() || count == 1) {
+		for (int i = 0; i < count; i++) task(i);
+		return;
+	}
+	// One job at a time: job, nextTask and finishedWorkers belong to the running one.
+	lock_guard<mutex> submitGuard(submitLock);
+	{
+		lock_guard<mutex> guard(lock);
+		job = &task;
+		jobCount = count;
+		nextTask = 0;
+		finishedWorkers = 0;
+		generation++;
+	}
+	wake.notify_all();
+	runTasks(task, count);
+
+	unique_lock<mutex> guard(lock);
+	done.wait(guard, [&] { return finishedWorkers == (int)workers.size(); });
+	job = NULL;
+}
+
+void scanParallel(threadPool& pool, const automaton* dfa, const char* text, size_t len, int64_t locationOffset, vector<matchEntry>& result) {
+	size_t numChunks = pool.size();
+	if (numChunks > len) numChunks = len > 0 ? len : 1;
+	size_t chunkSizeWithoutOverlap = (len + numChunks - 1) / numChunks;
+	size_t overlap = dfa->maxPatternLength > 0 ? dfa->maxPatternLength - 1 : 0;
+
+	vector<vector<matchEntry>> chunkResults(numChunks);
+	pool.parallelFor(numChunks, [&](int i) {
+		size_t offset = chunkSizeWithoutOverlap * i;
+		if (offset >= len) return;
+		size_t ownedEnd = offset + chunkSizeWithoutOverlap;
+		size_t chunkSize = chunkSizeWithoutOverlap + overlap;
+		if (chunkSize > len - offset) chunkSize = len - offset;
+
+		vector<matchEntry>& matches = chunkResults[i];
+		scanAutomaton(dfa, text + offset, chunkSize, offset, matches);
+
+		// Drop matches that start in the overlap; the next chunk reports them.
+		size_t kept = 0;
+		for (size_t j = 0; j < matches.size(); j++) {
+			if ((size_t)matches[j].position < ownedEnd) {
+				matches[kept++] = matches[j];
+			}
+		}
+		matches.resize(kept);
+	});
+
+	for (size_t i = 0; i < numChunks; i++) {
+		for (size_t j = 0; j < chunkResults[i].size(); j++) {
+			matchEntry m = chunkResults[i][j];
+			m.position += locationOffset;
+			result.push_back(m);
+		}
+	}
+}
+
+void countParallel(threadPool& pool, const automaton* dfa, const char* text, size_t len, int64_t* counts, countBuffers& buffers) {
+	size_t numChunks = pool.size();
+	if (numChunks > len) numChunks = len > 0 ? len : 1;
+	size_t chunkSize = (len + numChunks - 1) / numChunks;
+	size_t overlap = dfa->maxPatternLength > 0 ? dfa->maxPatternLength - 1 : 0;
+
+	// Growing only appends zeros, so the buffers stay zero outside the merge below.
+	vector<vector<int64_t>>& chunkCounts = buffers.chunkCounts;
+	if (chunkCounts.size() < numChunks) chunkCounts.resize(numChunks);
+	for (size_t i = 0; i < numChunks; i++) {
+		if (chunkCounts[i].size() < (size_t)dfa->numPatterns) chunkCounts[i].resize(dfa->numPatterns, 0);
+	}
+
+	pool.parallelFor(numChunks, [&](int i) {
+		size_t offset = chunkSize * i;
+		if (offset >= len) return;
+		size_t size = chunkSize < len - offset ? chunkSize : len - offset;
+		size_t warmUp = offset < overlap ? offset : overlap;
+
+		int32_t state = advanceAutomaton(dfa, 0, text + offset - warmUp, warmUp);
+		countAutomatonFrom(dfa, state, text + offset, size, chunkCounts[i].data());
+	});
+
+	// Clear while merging, which leaves the buffers ready for the next call.
+	for (size_t i = 0; i < numChunks; i++) {
+		int64_t* chunk = chunkCounts[i].data();
+		for (int32_t p = 0; p < dfa->numPatterns; p++) {
+			counts[p] += chunk[p];
+			chunk[p] = 0;
+		}
+	}
+}
+
+void scanRecords(threadPool& pool, const automaton* dfa, const scanRecord* records, size_t numRecords, vector<recordMatch>& result) {
+	// taskStart[t] is the first record of task t.
+	vector<size_t> taskStart;
+	size_t taskBytes = RECORD_TASK_SIZE;
+	for (size_t r = 0; r < numRecords; r++) {
+		if (taskBytes >= RECORD_TASK_SIZE) {
+			taskStart.push_back(r);
+			taskBytes = 0;
+		}
+		taskBytes += records[r].len;
+	}
+	taskStart.push_back(numRecords);
+	int numTasks = (int)taskStart.size() - 1;
+
+	vector<vector<recordMatch>> taskResults(numTasks);
+	pool.parallelFor(numTasks, [&](int t) {
+		vector<matchEntry> matches;
+		vector<recordMatch>& taskResult = taskResults[t];
+		for (size_t r = taskStart[t]; r < taskStart[t + 1]; r++) {
+			matches.clear();
+			scanAutomaton(dfa, records[r].data, records[r].len, 0, matches);
+			for (size_t j = 0; j < matches.size(); j++) {
+				recordMatch m;
+				m.record = (int64_t)r;
+				m.position = matches[j].position;
+				m.pattern = matches[j].pattern;
+				taskResult.push_back(m);
+			}
+		}
+	});
+
+	for (int t = 0; t < numTasks; t++) {
+		result.insert(result.end(), taskResults[t].begin(), taskResults[t].end());
+	}
+}
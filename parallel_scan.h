@@ -0,0 +1,120 @@
+// Multi-threaded scanning with a compiled automaton: of one large input, or of a batch of small records.
+
+#pragma once
+
+#include <stddef.h>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+#include "automaton.h"
+
+/**
+* Fixed set of worker threads that stay alive between scans. The calling thread
+* takes part in the work as well, so a pool of size n runs n - 1 extra threads.
+*/
+class threadPool {
+public:
+	// numThreads <= 0 selects std::thread::hardware_concurrency().
+	explicit threadPool(int numThreads = 0);
+	~threadPool();
+
+	int size() const { return numThreads; }
+
+	// Run task(i) for every i in [0, count) and return once all of them are done.
+	// Calls from several threads are serialized, each one gets the whole pool in turn.
+	// A task must not call parallelFor() on its own pool, which would wait on itself.
+	void parallelFor(int count, const std::function<void(int)>& task);
+
+private:
+	void workerLoop();
+	void runTasks(const std::function<void(int)>& task, int count);
+
+	int numThreads;
+	std::vector<std::thread> workers;
+	std::mutex submitLock;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int)>* job;
+	int jobCount;
+	std::atomic<int> nextTask;
+	int finishedWorkers;
+	unsigned long generation;
+	bool stopping;
+};
+
+/**
+* Scan text on all threads of the pool.
+* The text is split into one chunk per thread; each chunk is scanned maxPatternLength - 1
+* bytes past its end so matches crossing the boundary are found. A match is kept only by
+* the chunk its first character lies in, so overlap regions produce no duplicates.
+* Per-chunk results are appended to result in chunk order, which makes the output
+* independent of thread scheduling.
+* Input params:
+* - pool: Threads to scan on
+* - dfa: Automaton built by compileAutomaton()
+* - text: Input text
+* - len: Number of bytes to scan
+* - locationOffset: Offset value added to every reported location.
+* - result: Matches are appended to this vector.
+*/
+void scanParallel(threadPool& pool, const automaton* dfa, const char* text, size_t len, int64_t locationOffset, std::vector<matchEntry>& result);
+
+/**
+* Per-chunk counters of countParallel(), kept by the caller so that repeated counts allocate
+* nothing once they have grown to the pool and the pattern set. They are all zero between calls.
+* One countBuffers serves one countParallel() call at a time.
+*/
+struct countBuffers {
+	std::vector<std::vector<int64_t>> chunkCounts;
+};
+
+/**
+* Count matches per pattern on all threads of the pool, without storing any positions.
+* Each chunk counts the matches that end in it. It starts in the root state maxPatternLength - 1
+* bytes before its first byte, which is enough to see every match ending in the chunk.
+* Input params:
+* - pool: Threads to scan on
+* - dfa: Automaton built by compileAutomaton()
+* - text: Input text
+* - len: Number of bytes to scan
+* - counts: numPatterns counters; counts[p] is incremented by the number of matches of pattern p.
+* - buffers: Counters of the chunks, reused from earlier calls.
+*/
+void countParallel(threadPool& pool, const automaton* dfa, const char* text, size_t len, int64_t* counts, countBuffers& buffers);
+
+/**
+* One input of a batch: len bytes at data, which need not be NULL terminated.
+*/
+struct scanRecord {
+	const char* data;
+	size_t len;
+};
+
+/**
+* A match in a batch of records.
+* - record: Index of the record in the batch.
+* - position: Index of the first character of the match within the record.
+* - pattern: Pattern ID.
+*/
+struct recordMatch {
+	int64_t record;
+	int64_t position;
+	int32_t pattern;
+};
+
+/**
+* Scan every record of a batch on its own, on all threads of the pool. Consecutive records
+* are grouped into tasks of about RECORD_TASK_SIZE bytes, so a batch of many short records
+* costs one dispatch rather than one per record.
+* Input params:
+* - pool: Threads to scan on
+* - dfa: Automaton built by compileAutomaton()
+* - records, numRecords: The batch
+* - result: Matches are appended by record, and within a record in the order of scanAutomaton().
+*/
+void scanRecords(threadPool& pool, const automaton* dfa, const scanRecord* records, size_t numRecords, std::vector<recordMatch>& result);
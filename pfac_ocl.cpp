@@ -0,0 +1,873 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "pfac_ocl.h"
+#include "ocl_utils.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#define processId() ((unsigned long)GetCurrentProcessId())
+#else
+#include <unistd.h>
+#define processId() ((unsigned long)getpid())
+#endif
+
+#define SEPARATOR       ("----------------------------------------------------------------------\n")
+#define INTEL_PLATFORM  "Intel(R) OpenCL"
+
+using namespace std;
+
+// get platform id of an OpenCL platform with a device of the given type.
+// Intel's platform is preferred; any other platform (e.g. POCL for CPU devices) is used otherwise.
+cl_platform_id get_platform(cl_device_type type)
+{
+	// Trying to get a handle to Intel's OpenCL platform using function 
+	// 
+	// cl_int clGetPlatformIDs (cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms) 
+	// 
+	// num_entries is the number of cl_platform_id entries that can be added to platforms. If platforms 
+	// is not NULL, the num_entries must be greater than zero. 
+	// platforms returns a list of OpenCL platforms found. The cl_platform_id values returned in platforms 
+	// can be used to identify a specific OpenCL platform. If platforms argument is NULL, this argument is ignored. 
+	// The number of OpenCL platforms returned is the minimum of the value specified by num_entries or the number of 
+	// OpenCL platforms available. 
+	// num_platforms returns the number of OpenCL platforms available. If num_platforms is NULL, this argument is ignored. 
+	// 
+	// Trying to identify one platform: 
+
+	cl_platform_id platforms[10] = { NULL };
+	cl_uint num_platforms = 0;
+
+	cl_int err = clGetPlatformIDs(10, platforms, &num_platforms);
+
+	if (err != CL_SUCCESS) {
+		printf("Error: Failed to get a platform id!\n");
+		return NULL;
+	}
+
+	size_t returned_size = 0;
+	cl_char platform_name[1024] = { 0 }, platform_prof[1024] = { 0 }, platform_vers[1024] = { 0 }, platform_exts[1024] = { 0 };
+
+	for (unsigned int pass = 0; pass < 2; ++pass)
+	for (unsigned int ui = 0; ui < num_platforms; ++ui)
+	{
+		// Found one platform. Query specific information about the found platform using the function  
+		// 
+		// cl_int clGetPlatformInfo (cl_platform_id platform, cl_platform_info param_name, 
+		//                           size_t param_value_size, void *param_value,  
+		//                           size_t *param_value_size_ret) 
+		// 
+		// platform refers to the platform ID returned by clGetPlatformIDs or can be NULL. 
+		// If platform is NULL, the behavior is implementation-defined. 
+		// 
+		// param_name is an enumeration constant that identifies the platform information being queried. 
+		// We'll query the following information (for complete documentation, see Specification, page 30): 
+		// 
+		// CL_PLATFORM_NAME       -platform name string 
+		// CL_PLATFORM_VERSION    -OpenCL version supported by the implementation 
+		// CL_PLATFORM_PROFILE    -FULL_PROFILE if the implementation supports the OpenCL specification 
+		//                        -EMBEDDED_PROFILE - if the implementation supports the OpenCL embedded profile (subset). 
+		// CL_PLATFORM_EXTENSIONS -extension names supported by the platform 
+		// 
+		// param_value is a pointer to memory location where appropriate values for a given param_name will be returned. 
+		// If param_value is NULL, it is ignored. 
+		// 
+		// param_value_size specifies the size in bytes of memory pointed to by param_value. 
+		// param_value_size_ret returns the actual size in bytes of data being queried by param_value. 
+		// 
+		// Trying to query platform specific information... 
+
+		err = clGetPlatformInfo(platforms[ui], CL_PLATFORM_NAME, sizeof(platform_name), platform_name, &returned_size);
+		err |= clGetPlatformInfo(platforms[ui], CL_PLATFORM_VERSION, sizeof(platform_vers), platform_vers, &returned_size);
+		err |= clGetPlatformInfo(platforms[ui], CL_PLATFORM_PROFILE, sizeof(platform_prof), platform_prof, &returned_size);
+		err |= clGetPlatformInfo(platforms[ui], CL_PLATFORM_EXTENSIONS, sizeof(platform_exts), platform_exts, &returned_size);
+
+		if (err != CL_SUCCESS) {
+			printf("Error: Failed to get platform info!\n");
+			return NULL;
+		}
+
+		// check for Intel platform on the first pass, then for any platform with a device of the requested type
+		cl_uint num_devices = 0;
+		if (clGetDeviceIDs(platforms[ui], type, 0, NULL, &num_devices) != CL_SUCCESS || num_devices == 0) {
+			continue;
+		}
+		if (pass == 1 || !strcmp((char*)platform_name, INTEL_PLATFORM)) {
+			printf("\nPlatform information: %d\n", ui);
+			printf(SEPARATOR);
+			printf("Platform name:       %s\n", (char *)platform_name);
+			printf("Platform version:    %s\n", (char *)platform_vers);
+			printf("Platform profile:    %s\n", (char *)platform_prof);
+			printf("Platform extensions: %s\n", ((char)platform_exts[0] != '\0') ? (char *)platform_exts : "NONE");
+			return platforms[ui];
+		}
+	}
+
+	return NULL;
+}
+
+// read the kernel source code from a given file name 
+char* read_source(const char *file_name)
+{
+	FILE *file;
+	file = fopen(file_name, "rb");
+	if (!file) {
+		printf("Error: Failed to open file '%s'\n", file_name);
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END))
+	{
+		printf("Error: Failed to seek file '%s'\n", file_name);
+		fclose(file);
+		return NULL;
+	}
+	long size = ftell(file);
+	if (size == 0)
+	{
+		printf("Error: Failed to check position on file '%s'\n", file_name);
+		fclose(file);
+		return NULL;
+	}
+
+	rewind(file);
+
+	char *src = (char *)malloc(sizeof(char) * size + 1);
+	if (!src)
+	{
+		printf("Error: Failed to allocate memory for file '%s'\n", file_name);
+		fclose(file);
+		return NULL;
+	}
+	printf("Reading file '%s' (size %ld bytes)\n", file_name, size);
+
+	size_t res = fread(src, 1, sizeof(char) * size, file);
+	if (res != sizeof(char) * size)
+	{
+		printf("Error: Failed to read file '%s'\n", file_name);
+		fclose(file);
+		free(src);
+		return NULL;
+	}
+
+	src[size] = '\0'; // NULL terminated  
+	fclose(file);
+
+	return src;
+};
+// print the build log in case of failure 
+void build_fail_log(cl_program program, cl_device_id device_id)
+{
+	cl_int err = CL_SUCCESS;
+	size_t log_size = 0;
+
+	err = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+	if (CL_SUCCESS != err)
+	{
+		printf("Error: Failed to read build log length...\n");
+		return;
+	}
+
+	char* build_log = (char*)malloc(sizeof(char) * log_size + 1);
+	if (NULL != build_log)
+	{
+		err = clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, build_log, &log_size);
+		if (CL_SUCCESS != err)
+		{
+			printf("Error: Failed to read build log...\n");
+			free(build_log);
+			return;
+		}
+
+		build_log[log_size] = '\0';    // mark end of message string 
+
+		printf("Build Log:\n");
+		puts(build_log);
+		fflush(stdout);
+
+		free(build_log);
+	}
+}
+
+/**
+* Select a platform and a device of the given type and create the context and a
+* profiling command queue on it. The tables are loaded separately with pfacOclLoadTable().
+*/
+cl_int pfacOclCreate(pfacDevice* dev, cl_device_type type) {
+	cl_int err = CL_SUCCESS;
+	memset(dev, 0, sizeof(pfacDevice));
+	dev->textureMode = PFAC_AUTOMATIC;
+
+	dev->platform = get_platform(type);
+	if (NULL == dev->platform) {
+		printf("Error: failed to find a platform with a %s device...\n", type == CL_DEVICE_TYPE_CPU ? "CPU" : "GPU");
+		return CL_DEVICE_NOT_FOUND;
+	}
+
+	err = clGetDeviceIDs(dev->platform, type, 1, &dev->device, NULL);
+	char deviceName[1024] = { 0 };
+	err |= clGetDeviceInfo(dev->device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+	if (CL_SUCCESS != err || NULL == dev->device) {
+		printf("Error: Failed to get device on this platform!\n");
+		return CL_DEVICE_NOT_FOUND;
+	}
+	dev->deviceType = type;
+	printf("Selected device: %s (%s)\n", deviceName, type == CL_DEVICE_TYPE_CPU ? "CPU" : "GPU");
+
+	cl_context_properties properties[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)dev->platform, 0 };
+	dev->context = clCreateContext(properties, 1, &dev->device, NULL, NULL, &err);
+	if (CL_SUCCESS != err || NULL == dev->context) {
+		LogError("Error: Failed to create a compute context! Error %s\n", TranslateOpenCLError(err));
+		pfacOclRelease(dev);
+		return err != CL_SUCCESS ? err : CL_INVALID_CONTEXT;
+	}
+
+	dev->commands = clCreateCommandQueue(dev->context, dev->device, CL_QUEUE_PROFILING_ENABLE, &err);
+	if (CL_SUCCESS != err || NULL == dev->commands) {
+		LogError("Error: Failed to create a command queue! Error %s\n", TranslateOpenCLError(err));
+		pfacOclRelease(dev);
+		return err != CL_SUCCESS ? err : CL_INVALID_COMMAND_QUEUE;
+	}
+	return CL_SUCCESS;
+}
+
+/**
+* Build-time constants for PFAC.cl. MAX_PATTERN_SIZE is the number of ints a Work Group
+* reads past its own input so that matches starting near its end can complete.
+*/
+string pfacBuildOptions(const pfacDevice* dev) {
+	char options[256];
+	int maxPatternSize = (dev->maxPatternLength + sizeof(cl_int) - 1) / sizeof(cl_int);
+	if (maxPatternSize < 1) maxPatternSize = 1;
+	snprintf(options, sizeof(options), "-D INVALID=%d -D MASKBITS=%d -D MASK=%d -D WORK_GROUP_SIZE=%d -D MAX_PATTERN_SIZE=%d%s",
+		PFAC_INVALID, PFAC_MASKBITS, PFAC_MASK, (int)dev->workGroupSize, maxPatternSize, dev->useTexture ? " -D USE_TEXTURE" : "");
+	return options;
+}
+
+// Release the tables, leaving context, queue and program in place.
+static void releaseTables(pfacDevice* dev) {
+	cl_mem* tables[] = { &dev->imageInitialTransitions, &dev->imageHashRow, &dev->imageHashVal,
+		&dev->bufferInitialTransitions, &dev->bufferHashRow, &dev->bufferHashVal };
+	for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++) {
+		if (*tables[i]) clReleaseMemObject(*tables[i]);
+		*tables[i] = NULL;
+	}
+}
+
+// Release the program and its kernels.
+static void releaseProgram(pfacDevice* dev) {
+	if (dev->kernel) clReleaseKernel(dev->kernel);
+	if (dev->kernelCompact) clReleaseKernel(dev->kernelCompact);
+	if (dev->program) clReleaseProgram(dev->program);
+	dev->kernel = NULL;
+	dev->kernelCompact = NULL;
+	dev->program = NULL;
+	dev->programKey[0] = '\0';
+}
+
+// 64-bit FNV-1a hash of size bytes, continuing from hash.
+static unsigned long long fnv1a(unsigned long long hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+* File for the program binary of a kernel source built with the given options on dev's device.
+* The name hashes everything the binary depends on: the source, the options, and the device,
+* its OpenCL version and its driver version, so a driver update misses the cache instead of
+* loading a stale binary.
+* The binaries are kept next to the kernel file, or in the directory named by the environment
+* variable PFAC_KERNEL_CACHE. Setting PFAC_KERNEL_CACHE to an empty string disables the cache,
+* which is reported by an empty path.
+*/
+string pfacCachePath(const pfacDevice* dev, const char* kernelFile, const char* source, const string& options) {
+	const char* directory = getenv("PFAC_KERNEL_CACHE");
+	if (directory && '\0' == directory[0]) return string();
+
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = fnv1a(hash, source, strlen(source) + 1);
+	hash = fnv1a(hash, options.c_str(), options.size() + 1);
+	const cl_device_info infos[] = { CL_DEVICE_NAME, CL_DEVICE_VERSION, CL_DRIVER_VERSION };
+	for (size_t i = 0; i < sizeof(infos) / sizeof(infos[0]); i++) {
+		char info[1024] = { 0 };
+		clGetDeviceInfo(dev->device, infos[i], sizeof(info) - 1, info, NULL);
+		hash = fnv1a(hash, info, strlen(info) + 1);
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "pfac-%016llx.bin", hash);
+	if (directory) return string(directory) + "/" + name;
+	string path = kernelFile;
+	size_t slash = path.find_last_of("/\\");
+	return (slash == string::npos ? string() : path.substr(0, slash + 1)) + name;
+}
+
+// Create dev->program from a cached binary. Returns false if there is none or it does not load.
+static bool loadProgramBinary(pfacDevice* dev, const string& path, const string& options) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (NULL == file) return false;
+	vector<unsigned char> binary;
+	if (0 == fseek(file, 0, SEEK_END)) {
+		long size = ftell(file);
+		if (size > 0) {
+			binary.resize(size);
+			rewind(file);
+			if (fread(binary.data(), 1, binary.size(), file) != binary.size()) binary.clear();
+		}
+	}
+	fclose(file);
+	if (binary.empty()) return false;
+
+	const unsigned char* binaries[] = { binary.data() };
+	size_t sizes[] = { binary.size() };
+	cl_int binaryStatus = CL_SUCCESS;
+	cl_int err = CL_SUCCESS;
+	dev->program = clCreateProgramWithBinary(dev->context, 1, &dev->device, sizes, binaries, &binaryStatus, &err);
+	if (CL_SUCCESS == err && CL_SUCCESS == binaryStatus) {
+		err = clBuildProgram(dev->program, 1, &dev->device, options.c_str(), NULL, NULL);
+	}
+	if (CL_SUCCESS != err || CL_SUCCESS != binaryStatus) {
+		// Rejected, e.g. written by another driver: fall back to the source.
+		if (dev->program) clReleaseProgram(dev->program);
+		dev->program = NULL;
+		return false;
+	}
+	printf("Loaded program binary '%s'\n", path.c_str());
+	return true;
+}
+
+// Write the binary of the built dev->program. Concurrent writers each write their own file, named
+// after their process and device, and rename it into place.
+static void saveProgramBinary(const pfacDevice* dev, const string& path) {
+	size_t size = 0;
+	cl_int err = clGetProgramInfo(dev->program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL);
+	if (CL_SUCCESS != err || 0 == size) return;
+	vector<unsigned char> binary(size);
+	unsigned char* binaries[] = { binary.data() };
+	err = clGetProgramInfo(dev->program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, NULL);
+	if (CL_SUCCESS != err) return;
+
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%lu.%p.tmp", processId(), (const void*)dev);
+	string temporary = path + suffix;
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (NULL == file) {
+		printf("Warning: Failed to write program binary '%s'\n", path.c_str());
+		return;
+	}
+	bool written = fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+	written = (0 == fclose(file)) && written;
+	remove(path.c_str());
+	if (!written || 0 != rename(temporary.c_str(), path.c_str())) {
+		remove(temporary.c_str());
+		printf("Warning: Failed to write program binary '%s'\n", path.c_str());
+	}
+}
+
+/**
+* Build dev->program from kernelFile with the given options. A binary cached by an earlier
+* build for the same source, options and device is loaded instead of compiling the source;
+* after compiling, the binary is cached. See pfacCachePath().
+*/
+static cl_int buildProgram(pfacDevice* dev, const char* kernelFile, const string& options) {
+	cl_int err = CL_SUCCESS;
+	char* kernel_source = read_source(kernelFile);
+	if (NULL == kernel_source) {
+		printf("Error: Failed to read kernel source code from file name: %s!\n", kernelFile);
+		return CL_INVALID_VALUE;
+	}
+	string cachePath = pfacCachePath(dev, kernelFile, kernel_source, options);
+	if (!cachePath.empty() && loadProgramBinary(dev, cachePath, options)) {
+		free(kernel_source);
+		return CL_SUCCESS;
+	}
+
+	dev->program = clCreateProgramWithSource(dev->context, 1, (const char **)&kernel_source, NULL, &err);
+	free(kernel_source);
+	if (CL_SUCCESS != err || NULL == dev->program) {
+		printf("Error: Failed to create compute program! Error %s\n", TranslateOpenCLError(err));
+		return err != CL_SUCCESS ? err : CL_INVALID_PROGRAM;
+	}
+
+	err = clBuildProgram(dev->program, 1, &dev->device, options.c_str(), NULL, NULL);
+	if (CL_SUCCESS != err) {
+		printf("Error: Failed to build program executable!\n");
+		build_fail_log(dev->program, dev->device);
+		return err;
+	}
+	if (!cachePath.empty()) saveProgramBinary(dev, cachePath);
+	return CL_SUCCESS;
+}
+
+static cl_mem createTableImage(cl_context context, cl_mem buffer, cl_channel_order order, size_t width, cl_int* err) {
+	cl_image_format format;
+	format.image_channel_order = order;
+	format.image_channel_data_type = CL_SIGNED_INT32;
+	cl_image_desc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.image_type = CL_MEM_OBJECT_IMAGE1D_BUFFER;
+	desc.image_width = width;
+	desc.buffer = buffer;
+	return clCreateImage(context, CL_MEM_READ_ONLY, &format, &desc, NULL, err);
+}
+
+/**
+* Upload the PFAC tables and build the kernel for them.
+* Input params:
+* - dev: Device created by pfacOclCreate()
+* - table: Tables built by buildPfacTable()
+* - kernelFile: Path of PFAC.cl
+*/
+cl_int pfacOclLoadTable(pfacDevice* dev, const pfacTable& table, const char* kernelFile) {
+	cl_int err = CL_SUCCESS;
+	releaseTables(dev);
+	dev->initialState = table.initialState;
+	dev->maxPatternLength = table.maxPatternLength;
+
+	// Work Group size: a power of two, at most 256 and at most what the device allows.
+	size_t maxWorkGroupSize = 0;
+	clGetDeviceInfo(dev->device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+	dev->workGroupSize = 256;
+	while (dev->workGroupSize > 1 && dev->workGroupSize > maxWorkGroupSize) dev->workGroupSize >>= 1;
+
+	// Texture path only if images are supported and large enough for both hash tables.
+	cl_bool imageSupport = CL_FALSE;
+	size_t imageMaxBufferSize = 0;
+	clGetDeviceInfo(dev->device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, NULL);
+	if (imageSupport) {
+		clGetDeviceInfo(dev->device, CL_DEVICE_IMAGE_MAX_BUFFER_SIZE, sizeof(size_t), &imageMaxBufferSize, NULL);
+	}
+	size_t hashValSlots = table.hashVal.size() / 2;
+	bool textureFits = imageSupport && imageMaxBufferSize >= (size_t)table.numStates && imageMaxBufferSize >= hashValSlots;
+	if (dev->textureMode == PFAC_TEXTURE_ON && !textureFits) {
+		printf("Error: texture mode requested but the device cannot hold the tables in images\n");
+		return CL_IMAGE_FORMAT_NOT_SUPPORTED;
+	}
+	dev->useTexture = textureFits && dev->textureMode != PFAC_TEXTURE_OFF;
+
+	// hashVal may be empty when no pattern is longer than one byte; keep one slot so the buffer is valid.
+	vector<cl_int> hashVal(table.hashVal.begin(), table.hashVal.end());
+	if (hashVal.empty()) {
+		hashVal.push_back(-1);
+		hashVal.push_back(PFAC_INVALID);
+	}
+	dev->bufferInitialTransitions = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 256 * sizeof(cl_int), (void*)table.initialTransitions, &err);
+	if (CL_SUCCESS == err) {
+		dev->bufferHashRow = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, table.hashRow.size() * sizeof(cl_int), (void*)table.hashRow.data(), &err);
+	}
+	if (CL_SUCCESS == err) {
+		dev->bufferHashVal = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, hashVal.size() * sizeof(cl_int), hashVal.data(), &err);
+	}
+	if (CL_SUCCESS == err && dev->useTexture) {
+		dev->imageInitialTransitions = createTableImage(dev->context, dev->bufferInitialTransitions, CL_R, 256, &err);
+		if (CL_SUCCESS == err) dev->imageHashRow = createTableImage(dev->context, dev->bufferHashRow, CL_RG, table.numStates, &err);
+		if (CL_SUCCESS == err) dev->imageHashVal = createTableImage(dev->context, dev->bufferHashVal, CL_RG, hashVal.size() / 2, &err);
+	}
+	if (CL_SUCCESS != err) {
+		LogError("Error: Failed to create the PFAC tables on the device! Error %s\n", TranslateOpenCLError(err));
+		return err;
+	}
+
+	// Tables that need the same build options reuse the program.
+	string options = pfacBuildOptions(dev);
+	string programKey = string(kernelFile) + "\n" + options;
+	if (dev->program && programKey == dev->programKey) return CL_SUCCESS;
+	releaseProgram(dev);
+	err = buildProgram(dev, kernelFile, options);
+	if (CL_SUCCESS != err) {
+		releaseProgram(dev);
+		return err;
+	}
+
+	dev->kernel = clCreateKernel(dev->program, "pfac", &err);
+	if (CL_SUCCESS != err || NULL == dev->kernel) {
+		printf("Error: Failed to create compute kernel! Error %s\n", TranslateOpenCLError(err));
+		return err != CL_SUCCESS ? err : CL_INVALID_KERNEL;
+	}
+
+	dev->kernelCompact = clCreateKernel(dev->program, "pfacCompact", &err);
+	if (CL_SUCCESS != err || NULL == dev->kernelCompact) {
+		printf("Error: Failed to create compute kernel! Error %s\n", TranslateOpenCLError(err));
+		return err != CL_SUCCESS ? err : CL_INVALID_KERNEL;
+	}
+
+	cl_kernel kernels[] = { dev->kernel, dev->kernelCompact };
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		size_t kernelWorkGroupSize = 0;
+		clGetKernelWorkGroupInfo(kernels[i], dev->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelWorkGroupSize, NULL);
+		if (kernelWorkGroupSize < dev->workGroupSize) {
+			printf("Error: PFAC kernel supports Work Groups of %d, built for %d\n", (int)kernelWorkGroupSize, (int)dev->workGroupSize);
+			releaseProgram(dev);
+			return CL_INVALID_WORK_GROUP_SIZE;
+		}
+	}
+	if (programKey.size() < sizeof(dev->programKey)) {
+		strcpy(dev->programKey, programKey.c_str());
+	}
+	return CL_SUCCESS;
+}
+
+/**
+* Create the input buffer for a kernel launch and enqueue the upload of text.
+* The kernels read the input as ints; it is padded with zero bytes to a whole number of ints.
+*/
+static cl_int createInputBuffer(pfacDevice* dev, const char* text, size_t len, cl_int n, cl_mem* bufferInput) {
+	cl_int err = CL_SUCCESS;
+	*bufferInput = clCreateBuffer(dev->context, CL_MEM_READ_ONLY, n * sizeof(cl_int), NULL, &err);
+	if (CL_SUCCESS != err) {
+		LogError("Error: clCreateBuffer_Failed to create buffer! Error %s\n", TranslateOpenCLError(err));
+		return err;
+	}
+
+	const char padding[sizeof(cl_int)] = { 0 };
+	err = clEnqueueWriteBuffer(dev->commands, *bufferInput, CL_FALSE, 0, len, text, 0, NULL, NULL);
+	if (n * sizeof(cl_int) > len) {
+		err |= clEnqueueWriteBuffer(dev->commands, *bufferInput, CL_FALSE, len, n * sizeof(cl_int) - len, padding, 0, NULL, NULL);
+	}
+	if (CL_SUCCESS != err) {
+		LogError("Error: clEnqueueWriteBuffer_Failed to write the input! Error %s\n", TranslateOpenCLError(err));
+		clReleaseMemObject(*bufferInput);
+		*bufferInput = NULL;
+	}
+	return err;
+}
+
+// Arguments 0-3, shared by both kernels: the three tables and initialState.
+static cl_int setTableArgs(pfacDevice* dev, cl_kernel kernel) {
+	cl_mem tables[3] = { dev->bufferInitialTransitions, dev->bufferHashRow, dev->bufferHashVal };
+	if (dev->useTexture) {
+		tables[0] = dev->imageInitialTransitions;
+		tables[1] = dev->imageHashRow;
+		tables[2] = dev->imageHashVal;
+	}
+	cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &tables[0]);
+	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &tables[1]);
+	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &tables[2]);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_int), &dev->initialState);
+	return err;
+}
+
+// Store the duration of a finished kernel in dev->kernelTime.
+static void recordKernelTime(pfacDevice* dev, cl_event prof_event) {
+	cl_ulong start_time = 0, end_time = 0;
+	clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
+	clGetEventProfilingInfo(prof_event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
+	dev->kernelTime = (end_time - start_time) / 1000000.0;
+}
+
+/**
+* Run the pfac kernel over text.
+* Input params:
+* - dev: Device with tables loaded by pfacOclLoadTable()
+* - text: Input text, does not need to be NULL terminated
+* - len: Number of bytes to match
+* - output: len entries; output[i] receives the ID of the longest pattern starting at text[i], or -1.
+*/
+cl_int pfacOclMatch(pfacDevice* dev, const char* text, size_t len, cl_int* output) {
+	cl_int err = CL_SUCCESS;
+	if (len == 0) return CL_SUCCESS;
+	if (len > 0x7fffffff - 3) return CL_INVALID_BUFFER_SIZE;
+
+	cl_int inputSize = (cl_int)len;
+	cl_int n = (inputSize + sizeof(cl_int) - 1) / sizeof(cl_int);
+	cl_mem bufferInput = NULL;
+	err = createInputBuffer(dev, text, len, n, &bufferInput);
+	if (CL_SUCCESS != err) return err;
+	cl_mem bufferOutput = clCreateBuffer(dev->context, CL_MEM_WRITE_ONLY, len * sizeof(cl_int), NULL, &err);
+	if (CL_SUCCESS != err) {
+		LogError("Error: clCreateBuffer_Failed to create buffer! Error %s\n", TranslateOpenCLError(err));
+		clReleaseMemObject(bufferInput);
+		return err;
+	}
+
+	err = setTableArgs(dev, dev->kernel);
+	err |= clSetKernelArg(dev->kernel, 4, sizeof(cl_mem), &bufferInput);
+	err |= clSetKernelArg(dev->kernel, 5, sizeof(cl_mem), &bufferOutput);
+	err |= clSetKernelArg(dev->kernel, 6, sizeof(cl_int), &inputSize);
+	err |= clSetKernelArg(dev->kernel, 7, sizeof(cl_int), &n);
+	if (CL_SUCCESS != err) {
+		LogError("Error: clSetKernelArg_Failed to Set Kernel Arg! Error %s\n", TranslateOpenCLError(err));
+		clReleaseMemObject(bufferInput);
+		clReleaseMemObject(bufferOutput);
+		return err;
+	}
+
+	// One Work Item per int of input, rounded up to whole Work Groups.
+	size_t local[] = { dev->workGroupSize };
+	size_t global[] = { (n + dev->workGroupSize - 1) / dev->workGroupSize * dev->workGroupSize };
+	cl_event prof_event = NULL;
+	err = clEnqueueNDRangeKernel(dev->commands, dev->kernel, 1, NULL, global, local, 0, NULL, &prof_event);
+	if (CL_SUCCESS == err) {
+		err = clEnqueueReadBuffer(dev->commands, bufferOutput, CL_TRUE, 0, len * sizeof(cl_int), output, 0, NULL, NULL);
+	}
+	if (CL_SUCCESS != err) {
+		printf("Error: Failed to execute kernel! %s\n", TranslateOpenCLError(err));
+	}
+	else {
+		recordKernelTime(dev, prof_event);
+	}
+
+	if (prof_event) clReleaseEvent(prof_event);
+	clReleaseMemObject(bufferInput);
+	clReleaseMemObject(bufferOutput);
+	return err;
+}
+
+/**
+* Buffers and queue of one pipeline slot. The slot's commands run in order on its own
+* queue, so the slots overlap each other.
+*/
+struct pipelineSlot {
+	cl_command_queue queue;
+	cl_mem input;
+	cl_mem output;
+};
+
+static void releaseSlots(pipelineSlot* slots, int count) {
+	for (int i = 0; i < count; i++) {
+		if (slots[i].queue) {
+			clFinish(slots[i].queue);
+			clReleaseCommandQueue(slots[i].queue);
+		}
+		if (slots[i].input) clReleaseMemObject(slots[i].input);
+		if (slots[i].output) clReleaseMemObject(slots[i].output);
+	}
+}
+
+/**
+* Run the pfac kernel over text in chunks of chunkSize bytes, for input larger than device
+* memory or to overlap transfers with matching. Every chunk gets PFAC_PIPELINE_DEPTH slots'
+* worth of device memory at most, and the slots work in turn: while one chunk is read back,
+* the next is matched and the one after is uploaded.
+* The input buffers are allocated with CL_MEM_ALLOC_HOST_PTR and filled by mapping them, so
+* a device sharing memory with the host matches them in place, and other devices upload
+* from pinned memory. Each chunk is extended by maxPatternLength - 1 bytes of the next
+* one, so matches starting near its end complete; only its own positions are read back.
+* Input params:
+* - dev: Device with tables loaded by pfacOclLoadTable()
+* - text: Input text, does not need to be NULL terminated
+* - len: Number of bytes to match
+* - chunkSize: Input bytes per chunk, 0 for PFAC_PIPELINE_CHUNK_SIZE.
+* - output: len entries; output[i] receives the ID of the longest pattern starting at text[i], or -1.
+* dev->kernelTime receives the summed duration of the chunks' kernels.
+*/
+cl_int pfacOclMatchPipelined(pfacDevice* dev, const char* text, size_t len, size_t chunkSize, cl_int* output) {
+	cl_int err = CL_SUCCESS;
+	dev->kernelTime = 0;
+	if (len == 0) return CL_SUCCESS;
+	size_t overlap = dev->maxPatternLength > 0 ? dev->maxPatternLength - 1 : 0;
+	if (chunkSize == 0) chunkSize = PFAC_PIPELINE_CHUNK_SIZE;
+	if (chunkSize > len) chunkSize = len;
+	if (chunkSize + overlap > 0x7fffffff - 3) return CL_INVALID_BUFFER_SIZE;
+
+	// Largest chunk, with overlap. The kernel reads the input as ints, so its buffer is
+	// rounded up to whole ints; it writes one cl_int per input byte.
+	size_t maxBytes = chunkSize + overlap;
+	size_t maxInts = (maxBytes + sizeof(cl_int) - 1) / sizeof(cl_int);
+	pipelineSlot slots[PFAC_PIPELINE_DEPTH];
+	memset(slots, 0, sizeof(slots));
+	for (int i = 0; i < PFAC_PIPELINE_DEPTH && CL_SUCCESS == err; i++) {
+		slots[i].queue = clCreateCommandQueue(dev->context, dev->device, CL_QUEUE_PROFILING_ENABLE, &err);
+		if (CL_SUCCESS == err) slots[i].input = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, maxInts * sizeof(cl_int), NULL, &err);
+		if (CL_SUCCESS == err) slots[i].output = clCreateBuffer(dev->context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, maxBytes * sizeof(cl_int), NULL, &err);
+	}
+	if (CL_SUCCESS != err) {
+		LogError("Error: Failed to create the pipeline buffers! Error %s\n", TranslateOpenCLError(err));
+		releaseSlots(slots, PFAC_PIPELINE_DEPTH);
+		return err;
+	}
+
+	size_t numChunks = (len + chunkSize - 1) / chunkSize;
+	vector<cl_event> kernelEvents;
+	for (size_t c = 0; c < numChunks && CL_SUCCESS == err; c++) {
+		pipelineSlot& slot = slots[c % PFAC_PIPELINE_DEPTH];
+		size_t begin = c * chunkSize;
+		size_t owned = min(chunkSize, len - begin);
+		size_t size = min(owned + overlap, len - begin);
+		cl_int inputSize = (cl_int)size;
+		cl_int n = (cl_int)((size + sizeof(cl_int) - 1) / sizeof(cl_int));
+
+		// Mapping waits for the slot's previous chunk, which is done with the buffer by then.
+		char* staging = (char*)clEnqueueMapBuffer(slot.queue, slot.input, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, n * sizeof(cl_int), 0, NULL, NULL, &err);
+		if (CL_SUCCESS != err) break;
+		memcpy(staging, text + begin, size);
+		memset(staging + size, 0, n * sizeof(cl_int) - size);
+		err = clEnqueueUnmapMemObject(slot.queue, slot.input, staging, 0, NULL, NULL);
+
+		// Arguments are captured at enqueue time, so one kernel object serves every slot.
+		err |= setTableArgs(dev, dev->kernel);
+		err |= clSetKernelArg(dev->kernel, 4, sizeof(cl_mem), &slot.input);
+		err |= clSetKernelArg(dev->kernel, 5, sizeof(cl_mem), &slot.output);
+		err |= clSetKernelArg(dev->kernel, 6, sizeof(cl_int), &inputSize);
+		err |= clSetKernelArg(dev->kernel, 7, sizeof(cl_int), &n);
+		if (CL_SUCCESS != err) break;
+
+		size_t local[] = { dev->workGroupSize };
+		size_t global[] = { (n + dev->workGroupSize - 1) / dev->workGroupSize * dev->workGroupSize };
+		cl_event kernelEvent = NULL;
+		err = clEnqueueNDRangeKernel(slot.queue, dev->kernel, 1, NULL, global, local, 0, NULL, &kernelEvent);
+		if (CL_SUCCESS != err) break;
+		kernelEvents.push_back(kernelEvent);
+		err = clEnqueueReadBuffer(slot.queue, slot.output, CL_FALSE, 0, owned * sizeof(cl_int), output + begin, 0, NULL, NULL);
+		if (CL_SUCCESS == err) err = clFlush(slot.queue);
+	}
+	for (int i = 0; i < PFAC_PIPELINE_DEPTH; i++) {
+		cl_int finished = clFinish(slots[i].queue);
+		if (CL_SUCCESS == err) err = finished;
+	}
+	if (CL_SUCCESS != err) {
+		printf("Error: Failed to execute kernel! %s\n", TranslateOpenCLError(err));
+	}
+
+	double kernelTime = 0;
+	for (size_t i = 0; i < kernelEvents.size(); i++) {
+		if (CL_SUCCESS == err) {
+			recordKernelTime(dev, kernelEvents[i]);
+			kernelTime += dev->kernelTime;
+		}
+		clReleaseEvent(kernelEvents[i]);
+	}
+	dev->kernelTime = kernelTime;
+	releaseSlots(slots, PFAC_PIPELINE_DEPTH);
+	return err;
+}
+
+/**
+* Run the pfacCompact kernel over text and read back only the matches.
+* Input params:
+* - dev: Device with tables loaded by pfacOclLoadTable()
+* - text: Input text, does not need to be NULL terminated
+* - len: Number of bytes to match
+* - matches: Receives one (position, pattern ID) pair per match, sized to the number of matches.
+*/
+static cl_int matchCompact(pfacDevice* dev, const char* text, size_t len, vector<cl_int>& matches) {
+	cl_int err = CL_SUCCESS;
+	matches.clear();
+	if (len == 0) return CL_SUCCESS;
+	if (len > 0x7fffffff - 3) return CL_INVALID_BUFFER_SIZE;
+
+	cl_int inputSize = (cl_int)len;
+	cl_int n = (inputSize + sizeof(cl_int) - 1) / sizeof(cl_int);
+	size_t numGroups = (n + dev->workGroupSize - 1) / dev->workGroupSize;
+	cl_int numMatched = 0;
+	cl_mem bufferInput = NULL;
+	err = createInputBuffer(dev, text, len, n, &bufferInput);
+	if (CL_SUCCESS != err) return err;
+
+	// matches: one (index, value) pair per possible match; sums: one (workGroupSum, inclusivePrefix) pair per Work Group.
+	cl_mem bufferMatches = clCreateBuffer(dev->context, CL_MEM_WRITE_ONLY, len * 2 * sizeof(cl_int), NULL, &err);
+	cl_mem bufferSums = NULL;
+	cl_mem bufferGroupCounter = NULL;
+	cl_mem bufferNumMatched = NULL;
+	if (CL_SUCCESS == err) bufferSums = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, numGroups * 2 * sizeof(cl_int), NULL, &err);
+	if (CL_SUCCESS == err) bufferGroupCounter = clCreateBuffer(dev->context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &err);
+	if (CL_SUCCESS == err) bufferNumMatched = clCreateBuffer(dev->context, CL_MEM_WRITE_ONLY, sizeof(cl_int), NULL, &err);
+	if (CL_SUCCESS != err) {
+		LogError("Error: clCreateBuffer_Failed to create buffer! Error %s\n", TranslateOpenCLError(err));
+	}
+
+	const cl_int notAvailable = -1;
+	const cl_int zero = 0;
+	if (CL_SUCCESS == err) {
+		err = clEnqueueFillBuffer(dev->commands, bufferSums, &notAvailable, sizeof(cl_int), 0, numGroups * 2 * sizeof(cl_int), 0, NULL, NULL);
+		err |= clEnqueueFillBuffer(dev->commands, bufferGroupCounter, &zero, sizeof(cl_int), 0, sizeof(cl_int), 0, NULL, NULL);
+		err |= setTableArgs(dev, dev->kernelCompact);
+		err |= clSetKernelArg(dev->kernelCompact, 4, sizeof(cl_mem), &bufferInput);
+		err |= clSetKernelArg(dev->kernelCompact, 5, sizeof(cl_mem), &bufferMatches);
+		err |= clSetKernelArg(dev->kernelCompact, 6, sizeof(cl_mem), &bufferSums);
+		err |= clSetKernelArg(dev->kernelCompact, 7, sizeof(cl_mem), &bufferGroupCounter);
+		err |= clSetKernelArg(dev->kernelCompact, 8, sizeof(cl_mem), &bufferNumMatched);
+		err |= clSetKernelArg(dev->kernelCompact, 9, sizeof(cl_int), &inputSize);
+		err |= clSetKernelArg(dev->kernelCompact, 10, sizeof(cl_int), &n);
+		if (CL_SUCCESS != err) {
+			LogError("Error: clSetKernelArg_Failed to Set Kernel Arg! Error %s\n", TranslateOpenCLError(err));
+		}
+	}
+	cl_event prof_event = NULL;
+	if (CL_SUCCESS == err) {
+		size_t local[] = { dev->workGroupSize };
+		size_t global[] = { numGroups * dev->workGroupSize };
+		err = clEnqueueNDRangeKernel(dev->commands, dev->kernelCompact, 1, NULL, global, local, 0, NULL, &prof_event);
+		if (CL_SUCCESS == err) {
+			err = clEnqueueReadBuffer(dev->commands, bufferNumMatched, CL_TRUE, 0, sizeof(cl_int), &numMatched, 0, NULL, NULL);
+		}
+		if (CL_SUCCESS != err) {
+			printf("Error: Failed to execute kernel! %s\n", TranslateOpenCLError(err));
+		}
+	}
+	if (CL_SUCCESS == err && numMatched > 0) {
+		matches.resize(2 * (size_t)numMatched);
+		err = clEnqueueReadBuffer(dev->commands, bufferMatches, CL_TRUE, 0, matches.size() * sizeof(cl_int), matches.data(), 0, NULL, NULL);
+	}
+	if (CL_SUCCESS == err) recordKernelTime(dev, prof_event);
+	else matches.clear();
+
+	if (prof_event) clReleaseEvent(prof_event);
+	clReleaseMemObject(bufferInput);
+	if (bufferMatches) clReleaseMemObject(bufferMatches);
+	if (bufferSums) clReleaseMemObject(bufferSums);
+	if (bufferGroupCounter) clReleaseMemObject(bufferGroupCounter);
+	if (bufferNumMatched) clReleaseMemObject(bufferNumMatched);
+	return err;
+}
+
+/**
+* Run the pfacCompact kernel over text and read back only the matches.
+* Input params:
+* - dev: Device with tables loaded by pfacOclLoadTable()
+* - text: Input text, does not need to be NULL terminated
+* - len: Number of bytes to match
+* - patternIds, positions: len entries each; for k < *numMatched, pattern patternIds[k] is the
+*   longest one starting at text[positions[k]]. Positions are increasing.
+* - numMatched: Receives the number of matches.
+*/
+cl_int pfacOclMatchCompact(pfacDevice* dev, const char* text, size_t len, cl_int* patternIds, cl_int* positions, cl_int* numMatched) {
+	vector<cl_int> matches;
+	cl_int err = matchCompact(dev, text, len, matches);
+	*numMatched = matches.size() / 2;
+	for (cl_int k = 0; k < *numMatched; k++) {
+		positions[k] = matches[2 * k];
+		patternIds[k] = matches[2 * k + 1];
+	}
+	return err;
+}
+
+/**
+* Like pfacOclMatchCompact(), but the outputs are sized to the number of matches rather than
+* to len, for callers that do not know a bound on the matches up front.
+* Input params:
+* - dev: Device with tables loaded by pfacOclLoadTable()
+* - text: Input text, does not need to be NULL terminated
+* - len: Number of bytes to match
+* - patternIds, positions: Receive one entry per match; pattern patternIds[k] is the longest
+*   one starting at text[positions[k]]. Positions are increasing.
+*/
+cl_int pfacOclMatchCompact(pfacDevice* dev, const char* text, size_t len, vector<cl_int>& patternIds, vector<cl_int>& positions) {
+	vector<cl_int> matches;
+	cl_int err = matchCompact(dev, text, len, matches);
+	size_t numMatched = matches.size() / 2;
+	patternIds.resize(numMatched);
+	positions.resize(numMatched);
+	for (size_t k = 0; k < numMatched; k++) {
+		positions[k] = matches[2 * k];
+		patternIds[k] = matches[2 * k + 1];
+	}
+	return err;
+}
+
+// Release every OpenCL object held by dev. Safe to call on a partially created device.
+void pfacOclRelease(pfacDevice* dev) {
+	releaseTables(dev);
+	releaseProgram(dev);
+	if (dev->commands) clReleaseCommandQueue(dev->commands);
+	if (dev->context) clReleaseContext(dev->context);
+	memset(dev, 0, sizeof(pfacDevice));
+}
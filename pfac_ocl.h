@@ -0,0 +1,78 @@
+// Host side of the OpenCL PFAC matcher: device setup, table upload and kernel launch.
+
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include <CL/cl.h>
+
+#include <string>
+#include <vector>
+
+#include "PFAC.h"
+#include "pfac_table.h"
+
+// Chunks in flight in pfacOclMatchPipelined(): one uploading, one in the kernel, one reading back.
+#define PFAC_PIPELINE_DEPTH 3
+
+// Default input bytes per chunk of pfacOclMatchPipelined().
+#define PFAC_PIPELINE_CHUNK_SIZE (16 * 1024 * 1024)
+
+/**
+* OpenCL objects for running the pfac kernel on one device.
+* - textureMode: PFAC_AUTOMATIC binds the tables as image1d_buffer_t when the device
+*   supports images large enough, PFAC_TEXTURE_ON requires it and PFAC_TEXTURE_OFF
+*   always reads them from plain global buffers.
+* - useTexture: Result of that decision for the loaded tables.
+* - kernelTime: Duration of the last kernel in milliseconds, from the profiling event.
+* - programKey: Kernel file and build options the program was built with. Loading tables
+*   that need the same options keeps the program instead of building it again.
+*/
+struct pfacDevice {
+	cl_platform_id platform;
+	cl_device_id device;
+	cl_device_type deviceType;
+	cl_context context;
+	cl_command_queue commands;
+	cl_program program;
+	cl_kernel kernel;
+	cl_kernel kernelCompact;
+
+	cl_mem bufferInitialTransitions;
+	cl_mem bufferHashRow;
+	cl_mem bufferHashVal;
+	cl_mem imageInitialTransitions;
+	cl_mem imageHashRow;
+	cl_mem imageHashVal;
+
+	PFAC_textureMode_t textureMode;
+	bool useTexture;
+	size_t workGroupSize;
+	cl_int initialState;
+	cl_int maxPatternLength;
+	double kernelTime;
+	char programKey[512];
+};
+
+cl_platform_id get_platform(cl_device_type type);
+
+char* read_source(const char *file_name);
+
+void build_fail_log(cl_program program, cl_device_id device_id);
+
+cl_int pfacOclCreate(pfacDevice* dev, cl_device_type type);
+
+std::string pfacBuildOptions(const pfacDevice* dev);
+
+std::string pfacCachePath(const pfacDevice* dev, const char* kernelFile, const char* source, const std::string& options);
+
+cl_int pfacOclLoadTable(pfacDevice* dev, const pfacTable& table, const char* kernelFile);
+
+cl_int pfacOclMatch(pfacDevice* dev, const char* text, size_t len, cl_int* output);
+
+cl_int pfacOclMatchPipelined(pfacDevice* dev, const char* text, size_t len, size_t chunkSize, cl_int* output);
+
+cl_int pfacOclMatchCompact(pfacDevice* dev, const char* text, size_t len, cl_int* patternIds, cl_int* positions, cl_int* numMatched);
+
+cl_int pfacOclMatchCompact(pfacDevice* dev, const char* text, size_t len, std::vector<cl_int>& patternIds, std::vector<cl_int>& positions);
+
+void pfacOclRelease(pfacDevice* dev);
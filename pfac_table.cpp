@@ -0,0 +1,160 @@
+#include "pfac_table.h"
+
+using namespace std;
+
+/**
+* Find a multiplier k and a power of two slot count s so that mod257(k * c) & (s - 1)
+* is different for every byte c in chars. s = 512, k = 1 always works because
+* mod257(c) == c for every byte.
+*/
+static void findPerfectHash(const vector<int32_t>& chars, int32_t& k, int32_t& s) {
+	s = 1;
+	while (s < (int32_t)chars.size()) s <<= 1;
+	for (; s < 512; s <<= 1) {
+		for (k = 1; k <= 256; k++) {
+			bool used[512] = { false };
+			bool collision = false;
+			for (size_t i = 0; i < chars.size() && !collision; i++) {
+				int32_t p = mod257(k * chars[i]) & (s - 1);
+				collision = used[p];
+				used[p] = true;
+			}
+			if (!collision) return;
+		}
+	}
+	k = 1;
+	s = 512;
+}
+
+// Start empty tables for numStates states, of which those below initialState are final.
+static void initTable(pfacTable& table, int32_t numStates, vector<int32_t>& hashRow) {
+	table.numStates = numStates;
+	// Pattern IDs without a state of their own (duplicates) keep offset -1, i.e. no transitions.
+	hashRow.assign(2 * (size_t)numStates, 0);
+	for (int32_t s = 0; s < numStates; s++) {
+		hashRow[2 * s] = -1;
+	}
+	for (int b = 0; b < 256; b++) {
+		table.initialTransitions[b] = PFAC_INVALID;
+	}
+}
+
+// Hash the transitions of PFAC state state: byte chars[i] leads to state targets[i].
+static void addState(pfacTable& table, int32_t state, const vector<int32_t>& chars, const vector<int32_t>& targets,
+	vector<int32_t>& hashRow, vector<int32_t>& hashVal) {
+	if (chars.empty()) return;
+
+	if (state == table.initialState) {
+		for (size_t i = 0; i < chars.size(); i++) {
+			table.initialTransitions[chars[i]] = targets[i];
+		}
+	}
+
+	int32_t k, slots;
+	findPerfectHash(chars, k, slots);
+	int32_t offset = hashVal.size() / 2;
+	hashVal.resize(hashVal.size() + 2 * (size_t)slots);
+	for (int32_t i = 0; i < slots; i++) {
+		hashVal[2 * (offset + i)] = -1;
+		hashVal[2 * (offset + i) + 1] = PFAC_INVALID;
+	}
+	for (size_t i = 0; i < chars.size(); i++) {
+		int32_t p = mod257(k * chars[i]) & (slots - 1);
+		hashVal[2 * (offset + p)] = chars[i];
+		hashVal[2 * (offset + p) + 1] = targets[i];
+	}
+	hashRow[2 * state] = offset;
+	hashRow[2 * state + 1] = (k << PFAC_MASKBITS) | (slots - 1);
+}
+
+/**
+* Build the PFAC tables from a compiled automaton. PFAC threads only follow trie edges
+* and stop at the first missing one, so only the transitions with depth[t] == depth[s] + 1
+* are kept; the failure transitions folded into the DFA are dropped.
+* Input params:
+* - dfa: Automaton built by compileAutomaton()
+* - table: Receives the tables
+*/
+void buildPfacTable(const automaton* dfa, pfacTable& table) {
+	table.initialState = dfa->numPatterns;
+	table.maxPatternLength = dfa->maxPatternLength;
+
+	// Final states take the number of the (smallest) pattern ending there; everything else is numbered after initialState.
+	const flatArray<int32_t>& finalPattern = dfa->finalPattern;
+	vector<int32_t> pfacState(dfa->numStates);
+	int32_t nextState = table.initialState + 1;
+	for (int32_t s = 0; s < dfa->numStates; s++) {
+		if (s == 0) pfacState[s] = table.initialState;
+		else pfacState[s] = finalPattern[s] >= 0 ? finalPattern[s] : nextState++;
+	}
+	vector<int32_t> hashRow, hashVal;
+	initTable(table, nextState, hashRow);
+
+	vector<int32_t> chars, targets, row(dfa->numClasses);
+	for (int32_t s = 0; s < dfa->numStates; s++) {
+		transitionRow(dfa, s, row.data());
+		chars.clear();
+		targets.clear();
+		for (int b = 0; b < 256; b++) {
+			int32_t t = row[dfa->classOf[b]];
+			if (dfa->depth[t] == dfa->depth[s] + 1) {
+				chars.push_back(b);
+				targets.push_back(pfacState[t]);
+			}
+		}
+		addState(table, pfacState[s], chars, targets, hashRow, hashVal);
+	}
+	table.hashRow.assign(hashRow);
+	table.hashVal.assign(hashVal);
+}
+
+/**
+* Build the PFAC tables straight from a trie, without the dense transition table of
+* compileAutomaton(). The tables equal those of buildPfacTable() up to the order of the
+* states in hashVal, and need memory in proportion to the trie edges only, which is
+* what PFAC_SPACE_DRIVEN relies on for large pattern sets.
+* Input params:
+* - tree: Trie of the patterns; failure links are not needed
+* - patterns: The patterns the trie was built from
+* - table: Receives the tables
+*/
+void buildPfacTable(const trieArena* tree, const vector<string>& patterns, pfacTable& table) {
+	const vector<node>& nodes = tree->nodes;
+	table.initialState = patterns.size();
+	table.maxPatternLength = 0;
+	for (size_t i = 0; i < patterns.size(); i++) {
+		if ((int32_t)patterns[i].length() > table.maxPatternLength) table.maxPatternLength = patterns[i].length();
+	}
+
+	vector<int32_t> pfacState(nodes.size());
+	int32_t nextState = table.initialState + 1;
+	for (size_t n = 0; n < nodes.size(); n++) {
+		if (n == 0) pfacState[n] = table.initialState;
+		else pfacState[n] = nodes[n].firstPattern >= 0 ? nodes[n].firstPattern : nextState++;
+	}
+	vector<int32_t> hashRow, hashVal;
+	initTable(table, nextState, hashRow);
+
+	vector<int32_t> chars, targets;
+	for (size_t n = 0; n < nodes.size(); n++) {
+		chars.clear();
+		targets.clear();
+		for (uint32_t child = nodes[n].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+			chars.push_back(nodes[child].label);
+			targets.push_back(pfacState[child]);
+		}
+		addState(table, pfacState[n], chars, targets, hashRow, hashVal);
+	}
+	table.hashRow.assign(hashRow);
+	table.hashVal.assign(hashVal);
+}
+
+/**
+* Host version of the pfac kernel: output[i] is the ID of the longest pattern that
+* starts at text[i], or -1. Used to check the tables and the device results.
+*/
+void matchPfacTable(const pfacTable& table, const char* text, size_t len, int32_t* output) {
+	for (size_t i = 0; i < len; i++) {
+		output[i] = pfacLongestMatch(table, text, len, i);
+	}
+}
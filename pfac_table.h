@@ -0,0 +1,76 @@
+// PFAC (Parallel Failureless Aho Corasick) transition tables in the hashed format
+// read by the pfac kernel in PFAC.cl.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "automaton.h"
+#include "flat_array.h"
+
+// Build-time constants shared with PFAC.cl, see pfacBuildOptions().
+const int32_t PFAC_INVALID = -1;
+const int32_t PFAC_MASKBITS = 9;
+const int32_t PFAC_MASK = (1 << PFAC_MASKBITS) - 1;
+
+/**
+* The failureless trie of an automaton, renumbered and hashed for PFAC.
+* - initialState: States below initialState are final; such a state's number is the pattern ID it matches.
+*   Identical patterns share one final state, numbered with the smallest of their IDs.
+* - numStates: Number of entries in hashRow.
+* - maxPatternLength: Longest pattern; a thread never looks further than this past its start position.
+* - initialTransitions: Next state from initialState for every byte, or PFAC_INVALID.
+* - hashRow: Two ints per state: offset of the state's slots in hashVal (-1 if it has no transitions)
+*   and (k << PFAC_MASKBITS) | (s - 1), where s is the power of two slot count and k the hash multiplier.
+* - hashVal: Two ints per slot: the input byte (-1 for an empty slot) and the next state.
+*   The slot of byte c is mod257(k * c) & (s - 1).
+*/
+struct pfacTable {
+	int32_t initialState;
+	int32_t numStates;
+	int32_t maxPatternLength;
+	int32_t initialTransitions[256];
+	flatArray<int32_t> hashRow;
+	flatArray<int32_t> hashVal;
+};
+
+// Reduction modulo 257, identical to mod257() in PFAC.cl.
+inline int32_t mod257(int32_t x) {
+	int32_t mod = (x & 255) - (x >> 8);
+	if (mod < 0) {
+		mod += 257;
+	}
+	return mod;
+}
+
+void buildPfacTable(const automaton* dfa, pfacTable& table);
+
+void buildPfacTable(const trieArena* tree, const std::vector<std::string>& patterns, pfacTable& table);
+
+// Next state of the hashed trie, or PFAC_INVALID. Mirrors lookup() in PFAC.cl.
+inline int32_t pfacLookup(const pfacTable& table, int32_t state, uint8_t inputChar) {
+	int32_t offset = table.hashRow[2 * state];
+	if (offset < 0) return PFAC_INVALID;
+	int32_t k_sminus1 = table.hashRow[2 * state + 1];
+	int32_t sminus1 = k_sminus1 & PFAC_MASK;
+	int32_t k = k_sminus1 >> PFAC_MASKBITS;
+	int32_t p = mod257(k * inputChar) & sminus1;
+	if (table.hashVal[2 * (offset + p)] != inputChar) return PFAC_INVALID;
+	return table.hashVal[2 * (offset + p) + 1];
+}
+
+// ID of the longest pattern starting at text[start], or -1. One thread of the pfac kernel.
+inline int32_t pfacLongestMatch(const pfacTable& table, const char* text, size_t len, size_t start) {
+	int32_t match = -1;
+	int32_t state = table.initialTransitions[(uint8_t)text[start]];
+	for (size_t pos = start + 1; state != PFAC_INVALID; pos++) {
+		if (state < table.initialState) match = state;
+		if (pos >= len) break;
+		state = pfacLookup(table, state, (uint8_t)text[pos]);
+	}
+	return match;
+}
+
+void matchPfacTable(const pfacTable& table, const char* text, size_t len, int32_t* output);
@@ -0,0 +1,220 @@
+#include <string.h>
+
+#include "prefilter.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PREFILTER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang compile each vector variant for its own instruction set; MSVC needs no flag for intrinsics.
+#if defined(__GNUC__)
+#define PREFILTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PREFILTER_TARGET(isa)
+#endif
+
+// Skipping pays only while most bytes cannot start a match.
+const int MAX_START_BYTES = 128;
+
+/**
+* Build the filter for the set of bytes the root state has a transition on.
+* Input params:
+* - isStart: isStart[b] is true if a match can start with byte b.
+* - filter: Receives the filter.
+*/
+void buildFirstByteFilter(const bool isStart[256], firstByteFilter* filter) {
+	memset(filter, 0, sizeof(*filter));
+	int numStart = 0;
+	for (int b = 0; b < 256; b++) {
+		if (!isStart[b]) continue;
+		numStart++;
+		filter->isStart[b] = 1;
+		filter->lowNibble[b & 15] |= (uint8_t)(1 << ((b >> 4) & 7));
+	}
+	for (int h = 0; h < 16; h++) filter->highNibble[h] = (uint8_t)(1 << (h & 7));
+	filter->enabled = numStart > 0 && numStart <= MAX_START_BYTES;
+}
+
+static size_t nextCandidateScalar(const firstByteFilter* filter, const char* text, size_t pos, size_t len) {
+	while (pos < len && !filter->isStart[(uint8_t)text[pos]]) pos++;
+	return pos;
+}
+
+#ifdef PREFILTER_X86
+
+// Index of the lowest set bit of a non-zero mask.
+static inline unsigned lowestBit(uint64_t mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+#if defined(_M_X64)
+	_BitScanForward64(&index, mask);
+#else
+	if (!_BitScanForward(&index, (unsigned long)mask)) {
+		_BitScanForward(&index, (unsigned long)(mask >> 32));
+		index += 32;
+	}
+#endif
+	return index;
+#else
+	return (unsigned)__builtin_ctzll(mask);
+#endif
+}
+
+PREFILTER_TARGET("ssse3")
+static size_t nextCandidateSsse3(const firstByteFilter* filter, const char* text, size_t pos, size_t len) {
+	const __m128i lowTable = _mm_loadu_si128((const __m128i*)filter->lowNibble);
+	const __m128i highTable = _mm_loadu_si128((const __m128i*)filter->highNibble);
+	const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+	for (; pos + 16 <= len; pos += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(text + pos));
+		__m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(bytes, nibbleMask));
+		__m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibbleMask));
+		unsigned hits = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, high), zero)) ^ 0xffff;
+		if (hits) return pos + lowestBit(hits);
+	}
+	return nextCandidateScalar(filter, text, pos, len);
+}
+
+PREFILTER_TARGET("avx2")
+static size_t nextCandidateAvx2(const firstByteFilter* filter, const char* text, size_t pos, size_t len) {
+	const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)filter->lowNibble));
+	const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)filter->highNibble));
+	const __m256i nibbleMask = _mm256_set1_epi8(0x0f);
+	const __m256i zero = _mm256_setzero_si256();
+	for (; pos + 32 <= len; pos += 32) {
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)(text + pos));
+		__m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(bytes, nibbleMask));
+		__m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibbleMask));
+		uint32_t hits = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low, high), zero));
+		if (hits) return pos + lowestBit(hits);
+	}
+	return nextCandidateSsse3(filter, text, pos, len);
+}
+
+PREFILTER_TARGET("avx512f,avx512bw")
+static size_t nextCandidateAvx512(const firstByteFilter* filter, const char* text, size_t pos, size_t len) {
+	// Tables repeated in every 128-bit lane, as the byte shuffle works lane by lane.
+	uint8_t lowLanes[64], highLanes[64];
+	for (int lane = 0; lane < 4; lane++) {
+		memcpy(lowLanes + 16 * lane, filter->lowNibble, 16);
+		memcpy(highLanes + 16 * lane, filter->highNibble, 16);
+	}
+	const __m512i lowTable = _mm512_loadu_si512((const void*)lowLanes);
+	const __m512i highTable = _mm512_loadu_si512((const void*)highLanes);
+	const __m512i nibbleMask = _mm512_set1_epi8(0x0f);
+	for (; pos + 64 <= len; pos += 64) {
+		__m512i bytes = _mm512_loadu_si512((const void*)(text + pos));
+		__m512i low = _mm512_shuffle_epi8(lowTable, _mm512_and_si512(bytes, nibbleMask));
+		__m512i high = _mm512_shuffle_epi8(highTable, _mm512_and_si512(_mm512_srli_epi16(bytes, 4), nibbleMask));
+		uint64_t hits = _mm512_test_epi8_mask(low, high);
+		if (hits) return pos + lowestBit(hits);
+	}
+	return nextCandidateAvx2(filter, text, pos, len);
+}
+
+// Which vector extensions the CPU and the operating system support.
+static void detectCpu(bool& ssse3, bool& avx2, bool& avx512) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+	__cpuid(info, 1);
+	ssse3 = (info[2] & (1 << 9)) != 0;
+	// The OS must save the YMM (and for AVX-512 the ZMM and mask) registers.
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6;
+	bool zmm = (xcr0 & 0xe6) == 0xe6;
+	avx2 = avx512 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = ymm && (info[1] & (1 << 5)) != 0;
+		avx512 = zmm && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	ssse3 = __builtin_cpu_supports("ssse3") != 0;
+	avx2 = __builtin_cpu_supports("avx2") != 0;
+	avx512 = __builtin_cpu_supports("avx512f") != 0 && __builtin_cpu_supports("avx512bw") != 0;
+#endif
+}
+
+#endif
+
+typedef size_t (*nextCandidateFunction)(const firstByteFilter*, const char*, size_t, size_t);
+
+struct prefilterVariant {
+	const char* name;
+	nextCandidateFunction function;
+	bool supported;
+};
+
+// Every variant built for this target, widest first.
+static int listVariants(prefilterVariant* variants) {
+	int count = 0;
+#ifdef PREFILTER_X86
+	bool ssse3, avx2, avx512;
+	detectCpu(ssse3, avx2, avx512);
+	prefilterVariant x86[] = {
+		{ "avx512bw", nextCandidateAvx512, avx512 },
+		{ "avx2", nextCandidateAvx2, avx2 },
+		{ "ssse3", nextCandidateSsse3, ssse3 },
+	};
+	for (size_t i = 0; i < sizeof(x86) / sizeof(x86[0]); i++) variants[count++] = x86[i];
+#endif
+	prefilterVariant scalar = { "scalar", nextCandidateScalar, true };
+	variants[count++] = scalar;
+	return count;
+}
+
+static prefilterVariant bestVariant() {
+	prefilterVariant variants[4];
+	int count = listVariants(variants);
+	for (int i = 0; i < count; i++) {
+		if (variants[i].supported) return variants[i];
+	}
+	return variants[count - 1];
+}
+
+// Chosen once at startup.
+static prefilterVariant activeVariant = bestVariant();
+
+/**
+* Find the next position that can start a match.
+* Input params:
+* - filter: Filter built by buildFirstByteFilter()
+* - text: Input text
+* - pos: First position to look at
+* - len: Length of text
+* Returns the first position >= pos whose byte is a candidate, or len if there is none.
+*/
+size_t nextCandidate(const firstByteFilter* filter, const char* text, size_t pos, size_t len) {
+	return activeVariant.function(filter, text, pos, len);
+}
+
+// Name of the variant in use: avx512bw, avx2, ssse3 or scalar.
+const char* prefilterName() {
+	return activeVariant.name;
+}
+
+/**
+* Use the named variant instead of the one chosen at startup, e.g. to compare them.
+* Not thread safe; call it before scanning starts.
+* Returns false, leaving the variant unchanged, if the variant is unknown or the CPU lacks it.
+*/
+bool selectPrefilter(const char* name) {
+	prefilterVariant variants[4];
+	int count = listVariants(variants);
+	for (int i = 0; i < count; i++) {
+		if (strcmp(variants[i].name, name) == 0 && variants[i].supported) {
+			activeVariant = variants[i];
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,33 @@
+// Skipping over bytes that cannot start a match. While the automaton is in its root
+// state, every byte without a root transition leaves it there and reports nothing, so
+// the scanners jump straight to the next byte that can begin a pattern. The search for
+// that byte is vectorized; the widest variant the CPU supports is chosen at startup.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+* Bytes that can start a match, in the forms the skip loops need.
+* - enabled: false when skipping would not pay, e.g. because most bytes start a match.
+* - isStart: isStart[b] != 0 if the root has a transition on b.
+* - lowNibble, highNibble: Lookup tables of the vector search. Byte b is a candidate when
+*   lowNibble[b & 15] & highNibble[b >> 4] is not zero. High nibbles h and h + 8 share a bit,
+*   so a byte differing from a start byte only in its top bit is a candidate too; the
+*   automaton then simply stays in the root state. Text and patterns in ASCII are exact.
+*/
+struct firstByteFilter {
+	bool enabled;
+	uint8_t isStart[256];
+	uint8_t lowNibble[16];
+	uint8_t highNibble[16];
+};
+
+void buildFirstByteFilter(const bool isStart[256], firstByteFilter* filter);
+
+size_t nextCandidate(const firstByteFilter* filter, const char* text, size_t pos, size_t len);
+
+const char* prefilterName();
+
+bool selectPrefilter(const char* name);
@@ -0,0 +1,557 @@
+// Differential tests: every scanner and the PFAC API are checked against the reference trie
+// scan (scanText) on random pattern sets and texts, automaton files are checked to load
+// back into an automaton that scans the same, and the other ways of building an automaton are
+// checked against a build from scratch. Run by ctest; exits non-zero on any mismatch.
+// The GPU platform is not covered, as it needs an OpenCL device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <algorithm>
+
+#include "PFAC.h"
+#include "trie.h"
+#include "automaton.h"
+#include "automaton_file.h"
+#include "incremental_automaton.h"
+#include "parallel_scan.h"
+#include "parallel_build.h"
+#include "automaton_swap.h"
+#include "automaton_minimize.h"
+#include "pfac_table.h"
+
+using namespace std;
+
+// Random cases per run. Each one builds a fresh pattern set and text.
+const int NUM_CASES = 40;
+
+// Files the PFAC API and the automaton round trip read, in the working directory.
+const char* PATTERN_FILE = "tests_patterns.txt";
+const char* AUTOMATON_FILE = "tests_automaton.bin";
+
+// Bytes a pattern file cannot hold inside a pattern.
+const char* LINE_BREAKS = "\r\n";
+
+int failures = 0;
+
+static void check(bool ok, int testCase, const char* what) {
+	if (ok) return;
+	printf("FAILED case %d: %s\n", testCase, what);
+	failures++;
+}
+
+static bool matchLess(const matchEntry& a, const matchEntry& b) {
+	return a.position != b.position ? a.position < b.position : a.pattern < b.pattern;
+}
+
+static bool sameMatches(vector<matchEntry> a, vector<matchEntry> b) {
+	if (a.size() != b.size()) return false;
+	sort(a.begin(), a.end(), matchLess);
+	sort(b.begin(), b.end(), matchLess);
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].position != b[i].position || a[i].pattern != b[i].pattern) return false;
+	}
+	return true;
+}
+
+// Random subset of numSymbols distinct byte values, NUL and bytes >= 0x80 included, but none of excluded.
+static string randomAlphabet(int numSymbols, mt19937& rng, const char* excluded = "") {
+	string bytes;
+	for (int b = 0; b < 256; b++) {
+		if (b == 0 || strchr(excluded, b) == NULL) bytes += (char)b;
+	}
+	shuffle(bytes.begin(), bytes.end(), rng);
+	return bytes.substr(0, numSymbols);
+}
+
+static string randomString(const string& alphabet, size_t len, mt19937& rng) {
+	uniform_int_distribution<size_t> symbol(0, alphabet.size() - 1);
+	string s(len, '\0');
+	for (size_t i = 0; i < len; i++) s[i] = alphabet[symbol(rng)];
+	return s;
+}
+
+/**
+* A random test case: patterns, duplicates included, and a text with some of the patterns
+* copied into it. Patterns never contain line breaks, as they go through a pattern file in
+* checkPfacApi(). The symbols are one of
+* - the first few letters,
+* - a random subset of all 256 byte values,
+* - NUL and bytes >= 0x80 only,
+* - a few bytes in the patterns, and in the text those bytes and the ones differing from
+*   them only in the top bit, which share high nibble buckets h and h + 8 of the prefilter.
+*/
+struct testCase {
+	vector<string> patterns;
+	string text;
+};
+
+static testCase generateCase(mt19937& rng) {
+	testCase c;
+	int alphabetSize = uniform_int_distribution<int>(2, 8)(rng);
+	string patternAlphabet, textAlphabet;
+	switch (uniform_int_distribution<int>(0, 3)(rng)) {
+	case 0:
+		for (int i = 0; i < alphabetSize; i++) patternAlphabet += (char)('a' + i);
+		textAlphabet = patternAlphabet;
+		break;
+	case 1:
+		patternAlphabet = randomAlphabet(uniform_int_distribution<int>(2, 254)(rng), rng, LINE_BREAKS);
+		textAlphabet = patternAlphabet;
+		break;
+	case 2:
+		patternAlphabet = string(1, '\0');
+		for (int i = 1; i < alphabetSize; i++) patternAlphabet += (char)uniform_int_distribution<int>(0x80, 0xff)(rng);
+		textAlphabet = patternAlphabet;
+		break;
+	default:
+		patternAlphabet = randomAlphabet(alphabetSize, rng, LINE_BREAKS);
+		textAlphabet = patternAlphabet;
+		for (int i = 0; i < alphabetSize; i++) textAlphabet += (char)(patternAlphabet[i] ^ 0x80);
+		break;
+	}
+
+	int numPatterns = uniform_int_distribution<int>(1, 300)(rng);
+	int maxLength = uniform_int_distribution<int>(1, 24)(rng);
+	uniform_int_distribution<int> length(1, maxLength);
+	for (int i = 0; i < numPatterns; i++) {
+		c.patterns.push_back(randomString(patternAlphabet, length(rng), rng));
+	}
+
+	size_t textSize = uniform_int_distribution<size_t>(0, 20000)(rng);
+	c.text = randomString(textAlphabet, textSize, rng);
+	if (textSize == 0) return c;
+	uniform_int_distribution<size_t> which(0, c.patterns.size() - 1);
+	uniform_int_distribution<size_t> where(0, textSize - 1);
+	for (size_t k = 0; k < textSize / 64; k++) {
+		const string& pattern = c.patterns[which(rng)];
+		size_t position = where(rng);
+		if (pattern.length() <= textSize - position) memcpy(&c.text[position], pattern.data(), pattern.length());
+	}
+	return c;
+}
+
+/**
+* Length of the longest pattern starting at every position, from the reference matches.
+* Only matches that end at or before limit[position] count, which lets records cut the text.
+*/
+static vector<int32_t> longestAt(const vector<matchEntry>& reference, const automaton* dfa, size_t len, const vector<size_t>& limit) {
+	vector<int32_t> longest(len, 0);
+	for (size_t i = 0; i < reference.size(); i++) {
+		size_t position = (size_t)reference[i].position;
+		int32_t length = dfa->patternLength[reference[i].pattern];
+		if (position + length <= limit[position] && length > longest[position]) longest[position] = length;
+	}
+	return longest;
+}
+
+// The PFAC result for a position is right if it names a pattern of the longest length that occurs there.
+static bool sameLongest(const testCase& c, size_t position, int pattern, int32_t longest) {
+	if (pattern < 0) return longest == 0;
+	if ((size_t)pattern >= c.patterns.size()) return false;
+	const string& p = c.patterns[pattern];
+	return (int32_t)p.length() == longest && c.text.compare(position, p.length(), p) == 0;
+}
+
+static void checkScanners(int n, const testCase& c, const automaton* dfa, const vector<matchEntry>& reference, threadPool& pool, countBuffers& buffers) {
+	const char* text = c.text.data();
+	size_t len = c.text.size();
+
+	vector<matchEntry> result;
+	scanAutomaton(dfa, text, len, 0, result);
+	check(sameMatches(result, reference), n, "scanAutomaton");
+
+	int streams[] = { 1, 2, 3, MAX_STREAMS };
+	for (size_t k = 0; k < sizeof(streams) / sizeof(streams[0]); k++) {
+		result.clear();
+		scanInterleaved(dfa, text, len, 0, streams[k], result);
+		check(sameMatches(result, reference), n, "scanInterleaved");
+	}
+
+	result.clear();
+	scanParallel(pool, dfa, text, len, 0, result);
+	check(sameMatches(result, reference), n, "scanParallel");
+
+	// Several threads sharing the pool.
+	vector<matchEntry> shared[3];
+	vector<thread> callers;
+	for (int t = 0; t < 3; t++) {
+		callers.push_back(thread([&, t] { scanParallel(pool, dfa, text, len, 0, shared[t]); }));
+	}
+	for (size_t t = 0; t < callers.size(); t++) callers[t].join();
+	for (int t = 0; t < 3; t++) check(sameMatches(shared[t], reference), n, "scanParallel from several threads");
+
+	// Blocks of random sizes, empty ones included.
+	mt19937 rng(n);
+	scanStream stream;
+	streamInit(&stream, dfa);
+	result.clear();
+	for (size_t offset = 0; offset < len;) {
+		size_t block = min(len - offset, uniform_int_distribution<size_t>(0, 700)(rng));
+		streamScan(&stream, text + offset, block, result);
+		offset += block;
+	}
+	check(sameMatches(result, reference), n, "streamScan");
+
+	vector<int64_t> expected(dfa->numPatterns, 0);
+	for (size_t i = 0; i < reference.size(); i++) expected[reference[i].pattern]++;
+	vector<int64_t> counts(dfa->numPatterns, 0);
+	countParallel(pool, dfa, text, len, counts.data(), buffers);
+	check(counts == expected, n, "countParallel");
+
+	for (size_t k = 0; k < sizeof(streams) / sizeof(streams[0]); k++) {
+		fill(counts.begin(), counts.end(), 0);
+		countInterleaved(dfa, text, len, streams[k], counts.data());
+		check(counts == expected, n, "countInterleaved");
+	}
+}
+
+// scanRecords() over the text cut into records of random sizes, empty ones included.
+static void checkRecords(int n, const testCase& c, const automaton* dfa, threadPool& pool) {
+	mt19937 rng(n);
+	vector<scanRecord> records;
+	for (size_t offset = 0; offset < c.text.size();) {
+		size_t size = min(c.text.size() - offset, uniform_int_distribution<size_t>(0, 500)(rng));
+		scanRecord record = { c.text.data() + offset, size };
+		records.push_back(record);
+		offset += size;
+	}
+
+	// Every record on its own, in order.
+	vector<recordMatch> expected;
+	vector<matchEntry> matches;
+	for (size_t r = 0; r < records.size(); r++) {
+		matches.clear();
+		scanAutomaton(dfa, records[r].data, records[r].len, 0, matches);
+		for (size_t i = 0; i < matches.size(); i++) {
+			recordMatch m = { (int64_t)r, matches[i].position, matches[i].pattern };
+			expected.push_back(m);
+		}
+	}
+
+	vector<recordMatch> result;
+	scanRecords(pool, dfa, records.data(), records.size(), result);
+	bool ok = result.size() == expected.size();
+	for (size_t i = 0; ok && i < result.size(); i++) {
+		ok = result[i].record == expected[i].record && result[i].position == expected[i].position && result[i].pattern == expected[i].pattern;
+	}
+	check(ok, n, "scanRecords");
+}
+
+// Tables of a and b are the same, state for state.
+static bool sameAutomaton(const automaton* a, const automaton* b) {
+	if (a->numStates != b->numStates || a->numClasses != b->numClasses || memcmp(a->classOf, b->classOf, sizeof(a->classOf)) != 0) return false;
+	vector<int32_t> rowA(a->numClasses), rowB(b->numClasses);
+	for (int32_t s = 0; s < a->numStates; s++) {
+		transitionRow(a, s, rowA.data());
+		transitionRow(b, s, rowB.data());
+		if (rowA != rowB || a->outputLink[s] != b->outputLink[s] || a->depth[s] != b->depth[s] || a->finalPattern[s] != b->finalPattern[s]) return false;
+	}
+	return equal(a->nextPattern.begin(), a->nextPattern.end(), b->nextPattern.begin()) &&
+		equal(a->patternLength.begin(), a->patternLength.end(), b->patternLength.begin());
+}
+
+// The parallel builders against trie() and defineFailures() followed by compileAutomaton().
+static void checkParallelBuild(int n, const testCase& c, const automaton* dfa, const vector<matchEntry>& reference, threadPool& pool) {
+	trieArena* tree = trie(c.patterns);
+	defineFailuresParallel(pool, tree);
+	automaton* compiled = compileAutomatonParallel(pool, tree, c.patterns);
+	check(sameAutomaton(compiled, dfa), n, "defineFailuresParallel and compileAutomatonParallel");
+	delete compiled;
+	deleteTrie(tree);
+
+	// Sibling order may differ from trie(), and with it the state numbers, but not the matches.
+	tree = constructStateMachineParallel(pool, c.patterns);
+	compiled = compileAutomatonParallel(pool, tree, c.patterns);
+	vector<matchEntry> result;
+	scanAutomaton(compiled, c.text.data(), c.text.size(), 0, result);
+	check(compiled->numStates == dfa->numStates && sameMatches(result, reference), n, "constructStateMachineParallel");
+	delete compiled;
+	deleteTrie(tree);
+}
+
+/**
+* automatonSwap: reader slots are reused after removeReader(), and an automaton retired by
+* rebuildAsync() is only freed once the reader that entered before the swap has left.
+*/
+static void checkAutomatonSwap(int n, const testCase& c, const vector<matchEntry>& reference) {
+	const int maxReaders = 3;
+	trieArena* tree = trie(c.patterns);
+	defineFailures(tree);
+	automatonSwap swap(compileAutomaton(tree, c.patterns), maxReaders);
+	deleteTrie(tree);
+
+	int readers[maxReaders];
+	for (int i = 0; i < maxReaders; i++) readers[i] = swap.addReader();
+	check(readers[0] >= 0 && readers[1] >= 0 && readers[2] >= 0 && swap.addReader() < 0, n, "automatonSwap::addReader");
+	swap.removeReader(readers[1]);
+	check(swap.addReader() == readers[1], n, "automatonSwap::removeReader");
+	swap.removeReader(readers[2]);
+
+	// The new pattern set is the old one reversed, so every match keeps its position and changes its ID.
+	const automaton* old = swap.enter(readers[0]);
+	vector<string> reversed(c.patterns.rbegin(), c.patterns.rend());
+	swap.rebuildAsync(reversed);
+	swap.waitRebuild();
+	bool kept = swap.reclaim() == 0 && swap.retiredCount() == 1;
+	check(kept, n, "automatonSwap keeps the automaton of a reader");
+	vector<matchEntry> result;
+	if (kept) {
+		scanAutomaton(old, c.text.data(), c.text.size(), 0, result);
+		check(sameMatches(result, reference), n, "automatonSwap old automaton");
+	}
+	swap.exit(readers[0]);
+	check(swap.reclaim() == 1 && swap.retiredCount() == 0, n, "automatonSwap frees the automaton after exit()");
+
+	vector<matchEntry> expected(reference);
+	for (size_t i = 0; i < expected.size(); i++) expected[i].pattern = (int32_t)c.patterns.size() - 1 - expected[i].pattern;
+	result.clear();
+	scanAutomaton(swap.enter(readers[1]), c.text.data(), c.text.size(), 0, result);
+	swap.exit(readers[1]);
+	check(sameMatches(result, expected), n, "automatonSwap new automaton");
+}
+
+/**
+* minimizeAutomaton(): nothing merges in a freshly compiled automaton. After removing the
+* longest patterns and some others from an incrementalAutomaton, the tombstone leaves merge,
+* and the compacted snapshot scans exactly like the snapshot.
+*/
+static void checkMinimize(int n, const testCase& c, const automaton* dfa, const vector<matchEntry>& reference) {
+	minimizeReport report;
+	automaton* minimized = minimizeAutomaton(dfa, &report);
+	vector<matchEntry> result;
+	scanAutomaton(minimized, c.text.data(), c.text.size(), 0, result);
+	check(report.statesAfter == report.statesBefore && sameMatches(result, reference), n, "minimizeAutomaton of a compiled automaton");
+	delete minimized;
+
+	incrementalAutomaton incremental(c.patterns);
+	mt19937 rng(n);
+	for (size_t i = 0; i < c.patterns.size(); i++) {
+		if ((int32_t)c.patterns[i].length() == dfa->maxPatternLength || rng() % 3 == 0) incremental.remove(i);
+	}
+	automaton* snapshot = incremental.snapshot();
+	minimized = minimizeAutomaton(snapshot, &report);
+	vector<matchEntry> expected;
+	result.clear();
+	scanAutomaton(snapshot, c.text.data(), c.text.size(), 0, expected);
+	scanAutomaton(minimized, c.text.data(), c.text.size(), 0, result);
+	bool same = result.size() == expected.size();
+	for (size_t i = 0; same && i < result.size(); i++) {
+		same = result[i].position == expected[i].position && result[i].pattern == expected[i].pattern;
+	}
+	check(report.statesAfter < report.statesBefore && report.statesBefore == snapshot->numStates, n, "minimizeAutomaton merges tombstones");
+	check(same, n, "minimizeAutomaton of a snapshot");
+	delete minimized;
+	delete snapshot;
+}
+
+// A case large enough for levels of many parallel tasks.
+static testCase largeCase(mt19937& rng) {
+	testCase c;
+	string alphabet = randomAlphabet(6, rng, LINE_BREAKS);
+	uniform_int_distribution<int> length(4, 16);
+	for (int i = 0; i < 20000; i++) c.patterns.push_back(randomString(alphabet, length(rng), rng));
+	c.text = randomString(alphabet, 20000, rng);
+	return c;
+}
+
+static void checkPfacApi(int n, const testCase& c, const automaton* dfa, const vector<matchEntry>& reference) {
+	size_t len = c.text.size();
+	if (len == 0) return;
+	{
+		ofstream patternFile(PATTERN_FILE);
+		for (size_t i = 0; i < c.patterns.size(); i++) patternFile << c.patterns[i] << "\n";
+	}
+	PFAC_handle_t handle;
+	check(PFAC_create(&handle) == PFAC_STATUS_SUCCESS, n, "PFAC_create");
+
+	// Records cut the text at random points; the last one ends with it.
+	mt19937 rng(n);
+	vector<PFAC_record_t> records;
+	vector<size_t> recordOf(len);
+	vector<size_t> recordEnd(len);
+	for (size_t offset = 0; offset < len;) {
+		size_t size = min(len - offset, uniform_int_distribution<size_t>(1, 300)(rng));
+		PFAC_record_t record = { c.text.data() + offset, size };
+		for (size_t i = offset; i < offset + size; i++) {
+			recordOf[i] = records.size();
+			recordEnd[i] = offset + size;
+		}
+		records.push_back(record);
+		offset += size;
+	}
+	vector<size_t> textEnd(len, len);
+	vector<int32_t> longest = longestAt(reference, dfa, len, textEnd);
+	vector<int32_t> longestInRecord = longestAt(reference, dfa, len, recordEnd);
+
+	PFAC_platform_t platforms[] = { PFAC_PLATFORM_CPU, PFAC_PLATFORM_CPU_OMP };
+	PFAC_perfMode_t perfModes[] = { PFAC_TIME_DRIVEN, PFAC_SPACE_DRIVEN };
+	vector<int> matched(len), positions(len), recordIds(len);
+	for (int p = 0; p < 2; p++) {
+		for (int m = 0; m < 2; m++) {
+			PFAC_setPlatform(handle, platforms[p]);
+			PFAC_setPerfMode(handle, perfModes[m]);
+			check(PFAC_readPatternFromFile(handle, (char*)PATTERN_FILE) == PFAC_STATUS_SUCCESS, n, "PFAC_readPatternFromFile");
+
+			bool ok = PFAC_matchFromHost(handle, (char*)c.text.data(), len, matched.data()) == PFAC_STATUS_SUCCESS;
+			for (size_t i = 0; ok && i < len; i++) ok = sameLongest(c, i, matched[i], longest[i]);
+			check(ok, n, "PFAC_matchFromHost");
+
+			int numMatched = 0;
+			ok = PFAC_matchFromHostReduce(handle, (char*)c.text.data(), len, matched.data(), positions.data(), &numMatched) == PFAC_STATUS_SUCCESS;
+			int k = 0;
+			for (size_t i = 0; ok && i < len; i++) {
+				if (longest[i] == 0) continue;
+				ok = k < numMatched && positions[k] == (int)i && sameLongest(c, i, matched[k], longest[i]);
+				k++;
+			}
+			check(ok && k == numMatched, n, "PFAC_matchFromHostReduce");
+
+			ok = PFAC_matchRecords(handle, records.data(), (int)records.size(), matched.data(), recordIds.data(), positions.data(), &numMatched) == PFAC_STATUS_SUCCESS;
+			k = 0;
+			for (size_t i = 0; ok && i < len; i++) {
+				if (longestInRecord[i] == 0) continue;
+				size_t recordStart = (size_t)(records[recordOf[i]].data - c.text.data());
+				ok = k < numMatched && recordIds[k] == (int)recordOf[i] && positions[k] == (int)(i - recordStart) &&
+					sameLongest(c, i, matched[k], longestInRecord[i]);
+				k++;
+			}
+			check(ok && k == numMatched, n, "PFAC_matchRecords");
+		}
+	}
+	PFAC_destroy(handle);
+	remove(PATTERN_FILE);
+}
+
+static void checkAutomatonFile(int n, const testCase& c, const automaton* dfa, const vector<matchEntry>& reference) {
+	pfacTable table;
+	buildPfacTable(dfa, table);
+	FILE* fp = fopen(AUTOMATON_FILE, "wb");
+	bool saved = fp && saveAutomaton(fp, dfa, table);
+	if (fp) saved = (fclose(fp) == 0) && saved;
+	check(saved, n, "saveAutomaton");
+	if (!saved) return;
+
+	mappedFile file = { NULL, 0 };
+	automaton loaded;
+	pfacTable loadedTable;
+	bool ok = loadAutomaton(AUTOMATON_FILE, &file, &loaded, loadedTable);
+	check(ok, n, "loadAutomaton");
+	if (ok) {
+		check(loaded.transitions.empty() != loaded.narrowTransitions.empty(), n, "one transition table in the file");
+		vector<matchEntry> result;
+		scanAutomaton(&loaded, c.text.data(), c.text.size(), 0, result);
+		check(sameMatches(result, reference), n, "scanAutomaton of a loaded automaton");
+
+		vector<int32_t> expected(c.text.size()), output(c.text.size());
+		if (!c.text.empty()) {
+			matchPfacTable(table, c.text.data(), c.text.size(), expected.data());
+			matchPfacTable(loadedTable, c.text.data(), c.text.size(), output.data());
+		}
+		check(output == expected, n, "matchPfacTable of loaded tables");
+	}
+	unmapFile(&file);
+	remove(AUTOMATON_FILE);
+}
+
+/**
+* Random inserts and removes on an incrementalAutomaton, checked after every step against an
+* automaton built from scratch from every pattern inserted so far, with the matches of the
+* removed ones dropped. The inserted patterns draw on bytes the initial set lacks, which
+* adds class columns, and include empty patterns, which insert() must reject.
+*/
+static void checkIncremental(int n, mt19937& rng) {
+	string alphabet = randomAlphabet(uniform_int_distribution<int>(2, 10)(rng), rng);
+	string initialAlphabet = alphabet.substr(0, alphabet.size() / 2);
+	uniform_int_distribution<size_t> length(1, 8);
+	vector<string> patterns;
+	int numInitial = uniform_int_distribution<int>(0, 40)(rng);
+	for (int i = 0; i < numInitial; i++) patterns.push_back(randomString(initialAlphabet, length(rng), rng));
+	vector<bool> removed(patterns.size(), false);
+	string text = randomString(alphabet, 3000, rng);
+
+	incrementalAutomaton incremental(patterns);
+	for (int step = 0; step < 40; step++) {
+		int op = uniform_int_distribution<int>(0, 9)(rng);
+		if (op < 3 && !patterns.empty()) {
+			int32_t id = uniform_int_distribution<int32_t>(0, patterns.size() - 1)(rng);
+			check(incremental.remove(id) == !removed[id], n, "incrementalAutomaton::remove");
+			removed[id] = true;
+		}
+		else if (op == 3) {
+			check(incremental.insert("") == -1, n, "incrementalAutomaton::insert of the empty pattern");
+		}
+		else {
+			// Some inserts repeat a pattern, so identical patterns share a state.
+			string pattern = (op == 4 && !patterns.empty()) ? patterns[uniform_int_distribution<size_t>(0, patterns.size() - 1)(rng)] : randomString(alphabet, length(rng), rng);
+			check(incremental.insert(pattern) == (int32_t)patterns.size(), n, "incrementalAutomaton::insert");
+			patterns.push_back(pattern);
+			removed.push_back(false);
+		}
+
+		trieArena* stateMachine = trie(patterns);
+		defineFailures(stateMachine);
+		automaton* rebuilt = compileAutomaton(stateMachine, patterns);
+		vector<matchEntry> all, reference, result;
+		scanText(text.data(), text.size(), stateMachine, rebuilt->patternLength.data(), 0, all);
+		for (size_t i = 0; i < all.size(); i++) {
+			if (!removed[all[i].pattern]) reference.push_back(all[i]);
+		}
+		scanAutomaton(incremental.view(), text.data(), text.size(), 0, result);
+		check(sameMatches(result, reference), n, "incrementalAutomaton::view");
+		automaton* snapshot = incremental.snapshot();
+		result.clear();
+		scanAutomaton(snapshot, text.data(), text.size(), 0, result);
+		check(sameMatches(result, reference), n, "incrementalAutomaton::snapshot");
+		delete snapshot;
+		delete rebuilt;
+		deleteTrie(stateMachine);
+	}
+}
+
+int main(int argc, char** argv) {
+	unsigned seed = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 1;
+	mt19937 rng(seed);
+	threadPool pool(4);
+	countBuffers buffers;
+
+	for (int n = 0; n < NUM_CASES; n++) {
+		testCase c = generateCase(rng);
+		trieArena* stateMachine = trie(c.patterns);
+		defineFailures(stateMachine);
+		automaton* dfa = compileAutomaton(stateMachine, c.patterns);
+		vector<matchEntry> reference;
+		scanText(c.text.data(), c.text.size(), stateMachine, dfa->patternLength.data(), 0, reference);
+
+		checkScanners(n, c, dfa, reference, pool, buffers);
+		checkRecords(n, c, dfa, pool);
+		checkParallelBuild(n, c, dfa, reference, pool);
+		checkAutomatonSwap(n, c, reference);
+		checkMinimize(n, c, dfa, reference);
+		checkPfacApi(n, c, dfa, reference);
+		checkAutomatonFile(n, c, dfa, reference);
+		checkIncremental(n, rng);
+
+		delete dfa;
+		deleteTrie(stateMachine);
+	}
+
+	// Only the builders, which need many states per level to run in parallel at all.
+	testCase c = largeCase(rng);
+	trieArena* stateMachine = trie(c.patterns);
+	defineFailures(stateMachine);
+	automaton* dfa = compileAutomaton(stateMachine, c.patterns);
+	vector<matchEntry> reference;
+	scanText(c.text.data(), c.text.size(), stateMachine, dfa->patternLength.data(), 0, reference);
+	checkParallelBuild(NUM_CASES, c, dfa, reference, pool);
+	delete dfa;
+	deleteTrie(stateMachine);
+
+	printf("%d cases, seed %u: %d failures\n", NUM_CASES + 1, seed, failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
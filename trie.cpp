@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "trie.h"
+
+using namespace std;
+
+// Start an empty trie with room for totalLength non-root nodes.
+static trieArena* newTrie(size_t totalLength, size_t numPatterns) {
+	trieArena* tree = new trieArena();
+	tree->nodes.reserve(totalLength + 1);
+	node root = { NO_NODE, NO_NODE, NO_NODE, -1, NO_NODE, 0 };
+	tree->nodes.push_back(root);
+	for (int b = 0; b < ALPHA_SIZE; b++) tree->rootChildren[b] = NO_NODE;
+	tree->nextPattern.assign(numPatterns, -1);
+	return tree;
+}
+
+// Add pattern id, of len bytes, below the root. Patterns must be inserted in increasing ID order.
+static void insertPattern(trieArena* tree, const char* pattern, size_t len, int32_t id) {
+	uint32_t n = 0;
+	for (size_t j = 0; j < len; j++) {
+		uint8_t letter = (uint8_t)pattern[j];
+		uint32_t child = childOf(tree, n, letter);
+		if (NO_NODE == child) {
+			child = (uint32_t)tree->nodes.size();
+			node created = { NO_NODE, tree->nodes[n].firstChild, NO_NODE, -1, NO_NODE, letter };
+			tree->nodes.push_back(created);
+			tree->nodes[n].firstChild = child;
+			if (n == 0) tree->rootChildren[letter] = child;
+		}
+		n = child;
+	}
+	// Append to the chain of identical patterns, keeping it in ID order.
+	int32_t* link = &tree->nodes[n].firstPattern;
+	while (*link >= 0) link = &tree->nextPattern[*link];
+	*link = id;
+}
+
+/**
+* Build the trie of a pattern list; pattern IDs are the indices in the list.
+* Failure links and outputs are added by defineFailures().
+*/
+trieArena* trie(const vector<string>& patterns) {
+	size_t totalLength = 0;
+	for (size_t i = 0; i < patterns.size(); i++) totalLength += patterns[i].length();
+	trieArena* tree = newTrie(totalLength, patterns.size());
+	for (size_t i = 0; i < patterns.size(); i++) {
+		insertPattern(tree, patterns[i].data(), patterns[i].length(), (int32_t)i);
+	}
+	return tree;
+}
+
+/**
+* Set the failure and output links of child, a child of parent. Reads only nodes shallower
+* than child, whose links must already be set.
+*/
+void defineFailure(trieArena* tree, uint32_t parent, uint32_t child) {
+	vector<node>& nodes = tree->nodes;
+	// parent --c--> child.
+	// [parent's failure node] --c--> [child's failure node]
+	uint32_t failureNode = nodes[parent].failure;
+	uint32_t target = NO_NODE;
+	while (failureNode != NO_NODE && (target = childOf(tree, failureNode, nodes[child].label)) == NO_NODE) {
+		failureNode = nodes[failureNode].failure;
+	}
+	uint32_t failure = (failureNode == NO_NODE) ? 0 : target;
+	nodes[child].failure = failure;
+	nodes[child].outputLink = (nodes[failure].firstPattern >= 0) ? failure : nodes[failure].outputLink;
+}
+
+/**
+* Use BFS to establish failure transactions and output links.
+* Every child is visited, not just the letters, so that patterns containing
+* digits, symbols or binary bytes also get failure links. A failure node is always
+* shallower than its node, so its output link is set by the time it is needed.
+*/
+void defineFailures(trieArena* tree) {
+	if (!tree) return;
+	vector<node>& nodes = tree->nodes;
+
+	// order is the BFS queue; it is never popped, so order[k] is the k-th node in BFS order.
+	vector<uint32_t> order(1, 0);
+	order.reserve(nodes.size());
+	for (size_t k = 0; k < order.size(); k++) {
+		uint32_t parent = order[k];
+		for (uint32_t child = nodes[parent].firstChild; child != NO_NODE; child = nodes[child].nextSibling) {
+			order.push_back(child);
+			defineFailure(tree, parent, child);
+		}
+	}
+}
+
+trieArena* constructStateMachine(const char** patterns, int numOfPatterns) {
+	size_t totalLength = 0;
+	for (int i = 0; i < numOfPatterns; i++) totalLength += strlen(patterns[i]);
+	trieArena* stateMachine = newTrie(totalLength, numOfPatterns);
+	for (int i = 0; i < numOfPatterns; i++) {
+		insertPattern(stateMachine, patterns[i], strlen(patterns[i]), i);
+	}
+	defineFailures(stateMachine);
+	return stateMachine;
+}
+
+// Free a trie. All nodes go at once with the arena.
+void deleteTrie(trieArena* tree) {
+	delete tree;
+}
+
+/**
+* Use an established state machine to scan the input text.
+* Input params:
+* - text: Input text to find matches in; may contain NUL bytes
+* - len: Number of bytes to scan
+* - stateMachine: Trie with failure links, see constructStateMachine(). When no matches are possible, go back to the root node.
+* - patternLength: Length of every pattern, indexed by pattern ID.
+* - locationOffset: Offset value for reporting matching locations.
+* - result: Matches are appended in the order they end in the text. Locations are the index of the first character of the match.
+*/
+void scanText(const char* text, size_t len, const trieArena* stateMachine, const int32_t* patternLength, int64_t locationOffset, vector<matchEntry>& result) {
+	const vector<node>& nodes = stateMachine->nodes;
+	const int32_t* nextPattern = stateMachine->nextPattern.data();
+	uint32_t state = 0;
+	for (size_t i = 0; i < len; i++) {
+		uint8_t ch = (uint8_t)text[i];
+
+		// While there is no valid transaction for ch, switch to the failure transaction for the current state.
+		uint32_t next;
+		while ((next = childOf(stateMachine, state, ch)) == NO_NODE && state != 0) {
+			state = nodes[state].failure;
+		}
+
+		// Failing back to the root without a ch transaction means no match can end here.
+		if (NO_NODE == next) continue;
+
+		// Valid fail-back node with a ch transaction found. Go to the corresponding child node and
+		// record all matches: its own patterns, then those along the output links.
+		state = next;
+		uint32_t out = (nodes[state].firstPattern >= 0) ? state : nodes[state].outputLink;
+		for (; out != NO_NODE; out = nodes[out].outputLink) {
+			for (int32_t p = nodes[out].firstPattern; p >= 0; p = nextPattern[p]) {
+				matchEntry m;
+				m.pattern = p;
+				m.position = locationOffset + (int64_t)i + 1 - patternLength[p];
+				result.push_back(m);
+			}
+		}
+	}
+}
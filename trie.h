@@ -0,0 +1,81 @@
+// Aho Corasick trie. This is the reference implementation that the compiled automaton
+// (automaton.h) is generated from and validated against.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Children are looked up by the raw byte value, so matching is exact over all 256 byte values.
+const int ALPHA_SIZE = 256;
+
+// Node index meaning "no node", e.g. the failure node of the root.
+const uint32_t NO_NODE = 0xffffffff;
+
+/**
+* A single match reported by a scanner.
+* - position: Index of the first character of the match in the scanned text.
+* - pattern: Pattern ID, i.e. the index of the pattern in the list the state machine was built from.
+*/
+struct matchEntry {
+	int64_t position;
+	int32_t pattern;
+};
+
+/**
+* Trie node. Nodes live in a trieArena and refer to each other by 32-bit index; no node
+* stores its prefix, which is implied by the path from the root.
+* - firstChild, nextSibling: Children of a node form a singly linked list.
+* - failure: Node of the longest proper suffix that is also in the trie; NO_NODE for the root.
+* - firstPattern: Smallest ID of the patterns ending exactly here, -1 if none. Identical
+*   patterns share the node and are chained through trieArena::nextPattern.
+* - outputLink: Dictionary suffix link: the nearest node on the failure chain that has
+*   patterns of its own, NO_NODE if there is none. The patterns matched on reaching a node
+*   are its own followed by those of every node along its output links, so each pattern ID
+*   is stored exactly once however many suffix chains it ends.
+* - label: Byte on the edge from the parent.
+*/
+struct node {
+	uint32_t firstChild;
+	uint32_t nextSibling;
+	uint32_t failure;
+	int32_t firstPattern;
+	uint32_t outputLink;
+	uint8_t label;
+};
+
+/**
+* All nodes of one trie, allocated from a single block sized for the worst case (one node
+* per pattern byte) so building never reallocates. Node 0 is the root.
+* - rootChildren: Child of the root for every byte, NO_NODE if none. The root is the only
+*   node with many children, so it gets a direct table instead of a list walk.
+* - nextPattern: Next larger ID of an identical pattern, -1 at the end of a chain.
+*/
+struct trieArena {
+	std::vector<node> nodes;
+	uint32_t rootChildren[ALPHA_SIZE];
+	std::vector<int32_t> nextPattern;
+};
+
+// Child of state n on byte b, NO_NODE if there is none.
+inline uint32_t childOf(const trieArena* tree, uint32_t n, uint8_t b) {
+	if (n == 0) return tree->rootChildren[b];
+	for (uint32_t c = tree->nodes[n].firstChild; c != NO_NODE; c = tree->nodes[c].nextSibling) {
+		if (tree->nodes[c].label == b) return c;
+	}
+	return NO_NODE;
+}
+
+trieArena* trie(const std::vector<std::string>& patterns);
+
+void defineFailure(trieArena* tree, uint32_t parent, uint32_t child);
+
+void defineFailures(trieArena* tree);
+
+trieArena* constructStateMachine(const char** patterns, int numOfPatterns);
+
+void deleteTrie(trieArena* tree);
+
+void scanText(const char* text, size_t len, const trieArena* stateMachine, const int32_t* patternLength, int64_t locationOffset, std::vector<matchEntry>& result);